@@ -142,9 +142,17 @@ int birom32_check(struct birom32_state *state) {
 
 int birom32_write(struct birom32_state *state, uint32_t address, uint8_t *data, uint32_t size) {
 	int rc;
-	uint8_t buffer[4096];
+	uint8_t buffer[5];
+	uint16_t csum16 = 0;
+	uint32_t chunk;
 	memset(buffer, 0x00, sizeof(buffer));
 
+	//The size goes out in 16 bits.
+	if (size > 0xFFFF) {
+		LOGE("Cannot write %u bytes, the ROM takes at most 65535.", size);
+		return E_RANGE;
+	}
+
 	serial_purge(state->serial);
 	msleep(10);
 
@@ -197,17 +205,22 @@ int birom32_write(struct birom32_state *state, uint32_t address, uint8_t *data,
 
 	serial_drain(state->serial);
 
-	memcpy(buffer, data, size);
+	LOGD("Writing %d bytes to address 0x%04X.", size, address);
 
-	uint16_t csum16 = checksum16(buffer, size);
-	LOGD("Writing %d bytes to address 0x%04X. Checksum 0x%X", size, address, csum16);
+	//Send straight from data[] a tty buffer at a time, summing each piece while the previous one goes out.
+	for (uint32_t i = 0; i < size; i += chunk) {
+		chunk = (size - i < SERIAL_TXCHUNK) ? size - i : SERIAL_TXCHUNK;
+		csum16 += checksum16(data + i, chunk);
 
-	rc = serial_write(state->serial, buffer, size);
-	if (rc < 0 || rc < (int32_t)size) {
-		LOGE("Error writing to MCU.");
-		return E_WRITE;
+		rc = serial_write(state->serial, data + i, chunk);
+		if (rc < 0 || rc < (int32_t)chunk) {
+			LOGE("Error writing to MCU.");
+			return E_WRITE;
+		}
 	}
 
+	LOGD("Checksum 0x%X", csum16);
+
 	//Give MCU some breathing space.
 	serial_drain(state->serial);
 	msleep(250);
@@ -275,4 +288,203 @@ int birom32_call(struct birom32_state *state, uint32_t address) {
 	return E_NONE;
 }
 
+/**************************************************** Non-blocking *****************************************************/
+
+/**
+	Finish the current operation.
+	@param m State machine.
+	@param result The final result.
+	@return Returns result.
+*/
+static int birom32_finish(struct birom32_machine *m, int result) {
+	m->phase = BIROM32_PHASE_DONE;
+	m->result = result;
+	m->tx = NULL;
+	m->txlen = 0;
+	return result;
+}
+
+/**
+	Consume received bytes according to the command in progress.
+	@param m State machine.
+	@param rx Received bytes.
+	@param rxlen Number of bytes in rx[].
+	@param now Current time.
+*/
+static void birom32_receive(struct birom32_machine *m, const uint8_t *rx, int rxlen, double now) {
+	uint8_t c;
+
+	for (; rxlen > 0 && m->phase != BIROM32_PHASE_DONE; rx++, rxlen--) {
+		c = *rx;
+
+		//PROBE goes out repeatedly so the answer can come at any time.
+		if (m->phase == BIROM32_PHASE_COMMAND && m->cmd != BIROM32_CMD_PROBE) continue;
+
+		switch (m->cmd) {
+			case BIROM32_CMD_PROBE:
+				if (c == BIROM32_RESP_PROBE) {
+					LOGD("OK, MCU found.");
+					birom32_finish(m, E_NONE);
+				}
+				break;
+
+			case BIROM32_CMD_CHECK:
+				if (c == BIROM32_RESP_CHECK) birom32_finish(m, E_NONE);
+				break;
+
+			case BIROM32_CMD_WRITE:
+				if (m->phase == BIROM32_PHASE_PREAMBLE && c == BIROM32_RESP_WRITE) {
+					//Size of m_flash.* file followed by its contents.
+					m->cmdbuf[0] = (m->size & 0xFF);
+					m->cmdbuf[1] = (m->size >> 8) & 0xFF;
+					m->tx = m->cmdbuf;
+					m->txlen = 2;
+					m->phase = BIROM32_PHASE_PAYLOAD;
+				} else if (m->phase == BIROM32_PHASE_TRAILER && m->txlen == 0) {
+					m->rx[m->rxlen++] = c;
+					if (m->rxlen < 2) break;
+					uint16_t csum16chk = (m->rx[0] & 0x00FF) | ((m->rx[1] << 8) & 0xFF00);
+					if (m->csum != csum16chk) {
+						LOGE("Checksum mismatch! 0x%X (PC) != 0x%X (MCU)", m->csum, csum16chk);
+						birom32_finish(m, E_CRC);
+					} else {
+						birom32_finish(m, E_NONE);
+					}
+				}
+				break;
+
+			case BIROM32_CMD_CALL:
+				if (m->phase == BIROM32_PHASE_PREAMBLE) {
+					if (c != BIROM32_RESP_CALL) {
+						LOGE("Malformed response 0x%X from MCU.", c);
+						birom32_finish(m, E_MSGMALFORMED);
+						break;
+					}
+					m->phase = BIROM32_PHASE_TRAILER;
+				} else if (c == BIROM32_RESP_CALL_DONE) {
+					birom32_finish(m, E_NONE);
+				}
+				break;
+		}
+	}
+}
+
+int birom32_begin(struct birom32_machine *m, enum birom32_cmdid cmd, uint32_t address, uint8_t *data, uint32_t size, double now) {
+	assert(m);
+
+	if (m->phase != BIROM32_PHASE_IDLE && m->phase != BIROM32_PHASE_DONE) {
+		return E_ALREADY;
+	}
+
+	if (cmd == BIROM32_CMD_WRITE && (data == NULL || size == 0 || size > 0xFFFF)) {
+		return E_ARGUMENT;
+	}
+
+	//The size goes down the wire as 16 bits.
+	if (size > 0xFFFF) {
+		LOGE("Cannot write %u bytes, BIROM accepts at most 65535.", size);
+		return E_SIZE;
+	}
+
+	memset(m, 0x00, sizeof(struct birom32_machine));
+
+	m->cmd = cmd;
+	m->address = address;
+	m->data = data;
+	m->size = size;
+	m->result = E_WOULDBLOCK;
+	m->phase = BIROM32_PHASE_COMMAND;
+
+	m->cmdbuf[0] = cmd;
+	m->tx = m->cmdbuf;
+	m->txlen = 1;
+
+	switch (cmd) {
+		case BIROM32_CMD_PROBE:
+			m->timeout = now + 5;
+			m->deadline = now + 0.05;
+			return E_NONE;
+		case BIROM32_CMD_CHECK:
+			m->timeout = now + 1;
+			break;
+		case BIROM32_CMD_WRITE:
+		case BIROM32_CMD_CALL:
+			m->cmdbuf[1] = (address & 0x000000FF);
+			m->cmdbuf[2] = (address & 0x0000FF00) >> 8;
+			m->cmdbuf[3] = (address & 0x00FF0000) >> 16;
+			m->cmdbuf[4] = (address & 0xFF000000) >> 24;
+			m->txlen = 5;
+			m->timeout = now + (cmd == BIROM32_CMD_WRITE ? 2 : 1);
+			break;
+		default:
+			return E_ARGUMENT;
+	}
+
+	if (cmd == BIROM32_CMD_WRITE) {
+		m->csum = checksum16(data, size);
+	}
+
+	m->deadline = m->timeout;
+
+	return E_NONE;
+}
+
+int birom32_step(struct birom32_machine *m, const uint8_t *rx, int rxlen, double now) {
+	assert(m);
+
+	if (m->phase == BIROM32_PHASE_IDLE) return E_NOTREADY;
+	if (m->phase == BIROM32_PHASE_DONE) return m->result;
+
+	if (m->phase == BIROM32_PHASE_COMMAND && m->txlen == 0) {
+		m->phase = BIROM32_PHASE_PREAMBLE;
+	}
+
+	//Size is out, follow with the data, then wait for the checksum.
+	if (m->phase == BIROM32_PHASE_PAYLOAD && m->txlen == 0) {
+		if (m->tx == m->cmdbuf + 2) {
+			LOGD("Writing %d bytes to address 0x%04X. Checksum 0x%X", m->size, m->address, m->csum);
+			m->tx = m->data;
+			m->txlen = m->size;
+		} else {
+			m->phase = BIROM32_PHASE_TRAILER;
+			m->rxlen = 0;
+			m->timeout = now + 2;
+		}
+	}
+
+	if (rx && rxlen > 0) {
+		birom32_receive(m, rx, rxlen, now);
+		if (m->phase == BIROM32_PHASE_DONE) return m->result;
+	}
+
+	if (now >= m->timeout) {
+		LOGE("TIME-OUT");
+		return birom32_finish(m, E_TIMEOUT);
+	}
+
+	if (m->cmd == BIROM32_CMD_PROBE) {
+		if (now >= m->deadline && m->txlen == 0) {
+			m->cmdbuf[0] = BIROM32_CMD_PROBE;
+			m->tx = m->cmdbuf;
+			m->txlen = 1;
+			m->deadline = now + 0.05;
+		}
+		if (m->deadline > m->timeout) m->deadline = m->timeout;
+	} else {
+		m->deadline = m->timeout;
+	}
+
+	return E_WOULDBLOCK;
+}
+
+void birom32_sent(struct birom32_machine *m, int n) {
+	assert(m);
+
+	if (n <= 0) return;
+	if (n > m->txlen) n = m->txlen;
+
+	m->tx += n;
+	m->txlen -= n;
+}
+
 /** @} */
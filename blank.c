@@ -0,0 +1,124 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup blank
+@{
+*/
+#include "stdafx.h"
+
+#ifdef CPU_X86
+
+/**
+	Skip 0xFF with SSE2.
+	Four vectors are folded with AND so there is one compare per 64 bytes, the vector that
+	holds data is then located 16 bytes at a time.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@return Returns the offset of the first byte that is not 0xFF, or where fewer than 16 bytes remain.
+*/
+__attribute__((target("sse2")))
+static size_t blank_span_sse2(const uint8_t *buf, size_t size) {
+	const __m128i ones = _mm_set1_epi8((char)0xFF);
+	size_t i;
+	int mask;
+
+	for (i = 0; i + 64 <= size; i += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buf + i + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(buf + i + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(buf + i + 48));
+		__m128i all = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(all, ones)) != 0xFFFF) break;
+	}
+
+	for (; i + 16 <= size; i += 16) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), ones));
+		if (mask != 0xFFFF) {
+			return i + __builtin_ctz(~mask);
+		}
+	}
+
+	return i;
+}
+
+/**
+	Skip 0xFF with AVX2.
+	Same as blank_span_sse2() with 32 byte vectors.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@return Returns the offset of the first byte that is not 0xFF, or where fewer than 32 bytes remain.
+*/
+__attribute__((target("avx2")))
+static size_t blank_span_avx2(const uint8_t *buf, size_t size) {
+	const __m256i ones = _mm256_set1_epi8((char)0xFF);
+	size_t i;
+	uint32_t mask;
+
+	for (i = 0; i + 128 <= size; i += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(buf + i + 64));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(buf + i + 96));
+		__m256i all = _mm256_and_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, d));
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(all, ones)) != 0xFFFFFFFFu) break;
+	}
+
+	for (; i + 32 <= size; i += 32) {
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i)), ones));
+		if (mask != 0xFFFFFFFFu) {
+			return i + __builtin_ctz(~mask);
+		}
+	}
+
+	return i;
+}
+
+#endif //CPU_X86
+
+size_t blank_span(const uint8_t *buf, size_t size) {
+	uint64_t word;
+	size_t i = 0;
+
+#ifdef CPU_X86
+	enum cpu_level level = cpu_level();
+
+	if (level == CPU_LEVEL_AVX2) {
+		i = blank_span_avx2(buf, size);
+	} else if (level == CPU_LEVEL_SSE2) {
+		i = blank_span_sse2(buf, size);
+	}
+#endif
+
+	//A word at a time, memcpy() keeps unaligned loads legal.
+	for (; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, buf + i, sizeof(word));
+		if (word != ~(uint64_t)0) break;
+	}
+
+	//Leftovers, or the byte a wider path stopped in front of.
+	while (i < size && buf[i] == 0xFF) i++;
+
+	return i;
+}
+
+bool blank_isempty(const uint8_t *buf, size_t size) {
+	return blank_span(buf, size) == size;
+}
+
+/** @} */
@@ -0,0 +1,286 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup cache
+@{
+*/
+#include "stdafx.h"
+
+/** Changing this invalidates every existing cache entry. */
+static const char *cache_scheme = "KUJI32CACHE 1";
+
+/** Seconds a file must be left alone before its identity is trusted. */
+#define CACHE_SETTLE 2
+
+/**
+	Hash what makes two loads of a file produce the same image, apart from the file itself.
+	@param ctx Hash context to initialize.
+	@param mcu Name of the MCU.
+	@param low First address of the flash.
+	@param high Last address of the flash.
+*/
+static void cache_keyinit(struct sha256 *ctx, const char *mcu, uint32_t low, uint32_t high) {
+	uint32_t v[3] = { IMAGE_VERSION, low, high };
+
+	sha256_init(ctx);
+	sha256_update(ctx, cache_scheme, strlen(cache_scheme) + 1);
+	sha256_update(ctx, mcu, strlen(mcu) + 1);
+	sha256_update(ctx, v, sizeof(v));
+}
+
+/**
+	Compute the identity key of a file without reading it.
+	@param path Path to the file.
+	@param mcu Name of the MCU.
+	@param low First address of the flash.
+	@param high Last address of the flash.
+	@param hex Destination for the key, 2 * SHA256_SIZE characters and a terminating zero.
+	@param psettled Assigned true if the file has not been modified for CACHE_SETTLE seconds.
+	@return On success, returns E_NONE.
+	@return If the file can not be examined, returns E_OPEN.
+*/
+static int cache_identity(const char *path, const char *mcu, uint32_t low, uint32_t high, char *hex, bool *psettled) {
+	struct sha256 ctx;
+	uint8_t digest[SHA256_SIZE];
+	uint64_t id[FILEIDENTITY_SIZE];
+
+	if (fileidentity(path, id, CACHE_SETTLE, psettled) != E_NONE) {
+		return E_OPEN;
+	}
+
+	cache_keyinit(&ctx, mcu, low, high);
+	sha256_update(&ctx, id, sizeof(id));
+	sha256_final(&ctx, digest);
+	sha256_hex(digest, hex);
+
+	return E_NONE;
+}
+
+/**
+	Compute the content key of a file.
+	@param path Path to the file.
+	@param mcu Name of the MCU.
+	@param low First address of the flash.
+	@param high Last address of the flash.
+	@param hex Destination for the key, 2 * SHA256_SIZE characters and a terminating zero.
+	@return On success, returns E_NONE.
+	@return If the file can not be mapped, returns E_OPEN.
+*/
+static int cache_content(const char *path, const char *mcu, uint32_t low, uint32_t high, char *hex) {
+	struct sha256 ctx;
+	uint8_t digest[SHA256_SIZE];
+	const uint8_t *data;
+	size_t size;
+
+	data = filemap(path, &size);
+	if (data == NULL) {
+		return E_OPEN;
+	}
+
+	cache_keyinit(&ctx, mcu, low, high);
+	sha256_update(&ctx, data, size);
+	sha256_final(&ctx, digest);
+	sha256_hex(digest, hex);
+
+	fileunmap(data, size);
+	return E_NONE;
+}
+
+/**
+	Create a file to write a cache entry into before it is renamed into place.
+	The name is unique even when several stations share the cache directory.
+	@param dir Cache directory.
+	@param tmp Assigned the path of the new file, room for MAX_PATH characters.
+	@return On success, returns the file opened for binary writing.
+	@return On failure, returns NULL.
+*/
+static FILE *cache_tmpfile(const char *dir, char *tmp) {
+#ifdef __WIN32__
+	if (GetTempFileNameA(dir, "k32", 0, tmp) == 0) {
+		return NULL;
+	}
+	return fopen(tmp, "wb");
+#else
+	mode_t mask;
+	FILE *F;
+	int fd;
+
+	snprintf(tmp, MAX_PATH, "%s/.tmp.XXXXXX", dir);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	//mkstemp() makes the file private, the other stations must be able to read the entry.
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	F = fdopen(fd, "wb");
+	if (F == NULL) {
+		close(fd);
+		remove(tmp);
+	}
+	return F;
+#endif
+}
+
+/**
+	Write a file in the cache so that readers never see it half written.
+	@param dir Cache directory.
+	@param name Name of the file within dir.
+	@param image Image to save, or NULL to save text.
+	@param mcu Name of the MCU for the image.
+	@param text Contents of a text file.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int cache_store(const char *dir, const char *name, struct image *image, const char *mcu, const char *text) {
+	char path[MAX_PATH];
+	char tmp[MAX_PATH];
+	FILE *F;
+	int rc = E_NONE;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	F = cache_tmpfile(dir, tmp);
+	if (F == NULL) {
+		return E_OPEN;
+	}
+
+	if (image) {
+		rc = image_savestream(image, F, mcu);
+	} else if (fputs(text, F) < 0) {
+		rc = E_WRITE;
+	}
+	if (fclose(F) != 0) rc = E_WRITE;
+
+	//Another station may have stored the same entry meanwhile, either copy will do.
+	if (rc == E_NONE && rename(tmp, path) != 0) {
+		if (access(path, R_OK) != 0) rc = E_WRITE;
+		remove(tmp);
+	} else if (rc != E_NONE) {
+		remove(tmp);
+	}
+
+	return rc;
+}
+
+/**
+	Load an entry from the cache.
+	@param image The dereferenced pointer is assigned to the loaded image.
+	@param dir Cache directory.
+	@param key Content key of the entry.
+	@param mcu Name of the MCU.
+	@param low First address of the flash.
+	@param high Last address of the flash.
+	@return On a hit, returns E_NONE.
+	@return On a miss, returns E_NOTEXIST.
+*/
+static int cache_fetch(struct image **image, const char *dir, const char *key, const char *mcu, uint32_t low, uint32_t high) {
+	char path[MAX_PATH];
+	char name[32];
+
+	*image = NULL;
+
+	snprintf(path, sizeof(path), "%s/%s.k32", dir, key);
+	if (access(path, R_OK) != 0) {
+		return E_NOTEXIST;
+	}
+
+	//A damaged entry is a miss, it is replaced once the file is parsed.
+	if (image_load(image, path, name) != E_NONE) {
+		LOGW("Ignoring damaged cache entry '%s'.", path);
+		return E_NOTEXIST;
+	}
+
+	//The key covers the range already, this only guards against a damaged entry.
+	if (strcasecmp(name, mcu) != 0 || (*image)->base != (low & ~(IMAGE_BLOCK - 1)) || (*image)->end - 1 < high) {
+		image_free(image);
+		return E_NOTEXIST;
+	}
+
+	return E_NONE;
+}
+
+int cache_readimage(struct image **image, const char *dir, const char *path, cache_reader reader, const char *mcu, uint32_t address_low, uint32_t address_high) {
+	char identity[2 * SHA256_SIZE + 1];
+	char content[2 * SHA256_SIZE + 1];
+	char name[2 * SHA256_SIZE + 8];
+	char ref[MAX_PATH];
+	bool settled = false;
+	FILE *F;
+	int rc;
+
+	*image = NULL;
+
+	if (strcmp(path, "-") == 0 || cache_identity(path, mcu, address_low, address_high, identity, &settled) != E_NONE) {
+		return reader(image, path, address_low, address_high);
+	}
+
+#ifdef __WIN32__
+	CreateDirectoryA(dir, NULL);
+#else
+	mkdir(dir, 0777);
+#endif
+
+	//Fast path, the same file was loaded before and has not been touched since.
+	memset(content, 0x00, sizeof(content));
+	snprintf(ref, sizeof(ref), "%s/%s.ref", dir, identity);
+	F = fopen(ref, "r");
+	if (F) {
+		if (fgets(content, sizeof(content), F) && strlen(content) == 2 * SHA256_SIZE
+			&& cache_fetch(image, dir, content, mcu, address_low, address_high) == E_NONE) {
+			fclose(F);
+			LOGD("Loaded '%s' from cache by identity.", path);
+			return E_NONE;
+		}
+		fclose(F);
+	}
+
+	if (cache_content(path, mcu, address_low, address_high, content) != E_NONE) {
+		return reader(image, path, address_low, address_high);
+	}
+
+	rc = cache_fetch(image, dir, content, mcu, address_low, address_high);
+	if (rc == E_NONE) {
+		LOGD("Loaded '%s' from cache by contents.", path);
+	} else {
+		rc = reader(image, path, address_low, address_high);
+		if (rc != E_NONE) {
+			return rc;
+		}
+
+		//The cache is only an optimization, failing to fill it is not an error.
+		snprintf(name, sizeof(name), "%s.k32", content);
+		if (cache_store(dir, name, *image, mcu, NULL) != E_NONE) {
+			LOGW("Could not add '%s' to cache '%s'.", path, dir);
+			return E_NONE;
+		}
+	}
+
+	if (settled) {
+		snprintf(name, sizeof(name), "%s.ref", identity);
+		cache_store(dir, name, NULL, NULL, content);
+	}
+
+	return E_NONE;
+}
+
+/** @} */
@@ -0,0 +1,220 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup diff
+@{
+*/
+#include "stdafx.h"
+
+/**
+	Find the next block that holds data in either image.
+	@param from First image.
+	@param to Second image.
+	@param address Where to start looking.
+	@param end One past the compared range.
+	@return Returns the address of the block, or end if there is none.
+*/
+static uint32_t diff_next(struct image *from, struct image *to, uint32_t address, uint32_t end) {
+	uint32_t a = image_next(from, address);
+	uint32_t b = image_next(to, address);
+
+	if (a >= from->end) a = end;
+	if (b >= to->end) b = end;
+
+	return (a < b) ? a : b;
+}
+
+/**
+	Add a changed block, extending the last range if it is adjacent.
+	@param diff The diff.
+	@param address Address of the block.
+	@param nbytes Number of bytes that differ in the block.
+*/
+static void diff_add(struct diff *diff, uint32_t address, uint32_t nbytes) {
+	struct diff_range *last = diff->nranges ? &diff->ranges[diff->nranges - 1] : NULL;
+
+	diff->nchanged++;
+	diff->nbytes += nbytes;
+
+	if (last && last->end == address) {
+		last->end += IMAGE_BLOCK;
+		last->nbytes += nbytes;
+		return;
+	}
+
+	if (diff->nranges == diff->maxranges) {
+		diff->maxranges = diff->maxranges ? diff->maxranges * 2 : 16;
+		diff->ranges = (struct diff_range *)realloc(diff->ranges, diff->maxranges * sizeof(struct diff_range));
+		assert(diff->ranges);
+	}
+
+	last = &diff->ranges[diff->nranges++];
+	last->start = address;
+	last->end = address + IMAGE_BLOCK;
+	last->nbytes = nbytes;
+}
+
+int diff_images(struct diff **diff, struct image *from, struct image *to) {
+	uint8_t blank[IMAGE_BLOCK];
+	const uint8_t *a, *b;
+	uint32_t base, end, addr, n, i;
+	bool fromempty, toempty;
+
+	assert(diff);
+	assert(from);
+	assert(to);
+
+	*diff = NULL;
+
+	if ((from->base - to->base) % IMAGE_BLOCK != 0) {
+		LOGE("Images at 0x%06X and 0x%06X do not share block boundaries.", from->base, to->base);
+		return E_RANGE;
+	}
+
+	struct diff *d = (struct diff *)calloc(1, sizeof(struct diff));
+	assert(d);
+
+	base = (from->base < to->base) ? from->base : to->base;
+	end = (from->end > to->end) ? from->end : to->end;
+	d->nblocks = (end - base) / IMAGE_BLOCK;
+	d->exact = true;
+
+	memset(blank, 0xFF, sizeof(blank));
+
+	for (addr = diff_next(from, to, base, end); addr < end; addr = diff_next(from, to, addr + IMAGE_BLOCK, end)) {
+		fromempty = image_isempty(from, addr);
+		toempty = image_isempty(to, addr);
+
+		if (!toempty) {
+			d->nprogram++;
+		}
+
+		a = fromempty ? blank : image_block(from, addr);
+		b = toempty ? blank : image_block(to, addr);
+
+		//Equal CRCs are confirmed, a 16 bit CRC collides too easily to be trusted alone.
+		if (image_crc(from, addr) == image_crc(to, addr) && memcmp(a, b, IMAGE_BLOCK) == 0) {
+			continue;
+		}
+
+		for (i = 0, n = 0; i < IMAGE_BLOCK; i++) {
+			n += (a[i] != b[i]);
+		}
+		diff_add(d, addr, n);
+	}
+
+	*diff = d;
+	return E_NONE;
+}
+
+int diff_manifests(struct diff **diff, struct manifest *from, struct manifest *to) {
+	uint32_t base, end, addr;
+	bool fromempty, toempty;
+
+	assert(diff);
+	assert(from && from->finished);
+	assert(to && to->finished);
+
+	*diff = NULL;
+
+	if ((from->base - to->base) % IMAGE_BLOCK != 0) {
+		LOGE("Manifests at 0x%06X and 0x%06X do not share block boundaries.", from->base, to->base);
+		return E_RANGE;
+	}
+
+	struct diff *d = (struct diff *)calloc(1, sizeof(struct diff));
+	assert(d);
+
+	base = (from->base < to->base) ? from->base : to->base;
+	end = (from->end > to->end) ? from->end : to->end;
+	d->nblocks = (end - base) / IMAGE_BLOCK;
+
+	for (addr = base; addr < end; addr += IMAGE_BLOCK) {
+		fromempty = manifest_isempty(from, addr);
+		toempty = manifest_isempty(to, addr);
+
+		if (fromempty && toempty) {
+			continue;
+		}
+
+		if (!toempty) {
+			d->nprogram++;
+		}
+
+		if (manifest_crc(from, addr) != manifest_crc(to, addr)) {
+			diff_add(d, addr, 0);
+		}
+	}
+
+	if (d->nchanged == 0 && memcmp(from->hash, to->hash, SHA256_SIZE) != 0) {
+		LOGD("Block CRCs match but image hashes differ.");
+		diff_free(&d);
+		return E_MISMATCH;
+	}
+
+	*diff = d;
+	return E_NONE;
+}
+
+double diff_seconds(uint32_t nblocks, uint32_t baud) {
+	if (baud == 0) {
+		return 0;
+	}
+	return (double)nblocks * DIFF_FRAME * DIFF_BITS / baud;
+}
+
+void diff_print(struct diff *diff, const char *from, const char *to, uint32_t baud) {
+	assert(diff);
+
+	LOGI("== Image Diff: '%s' -> '%s' ==", from, to);
+
+	for (uint32_t r = 0; r < diff->nranges; r++) {
+		struct diff_range *range = &diff->ranges[r];
+		if (diff->exact) {
+			LOGI("Changed 0x%06X - 0x%06X: %u blocks, %u bytes.", range->start, range->end - 1, (range->end - range->start) / IMAGE_BLOCK, range->nbytes);
+		} else {
+			LOGI("Changed 0x%06X - 0x%06X: %u blocks.", range->start, range->end - 1, (range->end - range->start) / IMAGE_BLOCK);
+		}
+	}
+
+	if (diff->nchanged == 0) {
+		LOGI("Images are identical, %u blocks compared.", diff->nblocks);
+		return;
+	}
+
+	if (diff->exact) {
+		LOGI("%u of %u blocks differ in %u ranges, %u bytes in all.", diff->nchanged, diff->nblocks, diff->nranges, diff->nbytes);
+	} else {
+		LOGI("%u of %u blocks differ in %u ranges.", diff->nchanged, diff->nblocks, diff->nranges);
+	}
+
+	//The kernal only erases the whole chip, so a re-flash writes every block that holds data.
+	LOGI("Full re-flash:        %u blocks, about %.1f s at %u bps.", diff->nprogram, diff_seconds(diff->nprogram, baud), baud);
+	LOGI("Changed blocks alone: %u blocks, about %.1f s.", diff->nchanged, diff_seconds(diff->nchanged, baud));
+}
+
+void diff_free(struct diff **diff) {
+	if (diff && *diff) {
+		free((*diff)->ranges);
+		free(*diff);
+		*diff = NULL;
+	}
+}
+
+/** @} */
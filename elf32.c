@@ -0,0 +1,141 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup elf32
+@{
+*/
+#include "stdafx.h"
+
+/** Offsets of the fields we use in the ELF header and program header. */
+enum elf32_offset {
+	ELF32_EI_CLASS		= 4,	/**< 1 for 32 bit files. */
+	ELF32_EI_DATA		= 5,	/**< 1 for little endian, 2 for big endian. */
+	ELF32_E_PHOFF		= 28,	/**< File offset of the program header table. */
+	ELF32_E_PHENTSIZE	= 42,	/**< Size of a program header. */
+	ELF32_E_PHNUM		= 44,	/**< Number of program headers. */
+	ELF32_EHSIZE		= 52,	/**< Size of the ELF header. */
+	ELF32_P_TYPE		= 0,	/**< Segment type. */
+	ELF32_P_OFFSET		= 4,	/**< File offset of the segment contents. */
+	ELF32_P_PADDR		= 12,	/**< Physical i.e. load address. */
+	ELF32_P_FILESZ		= 16,	/**< Number of bytes in the file. */
+	ELF32_PHSIZE		= 32,	/**< Smallest valid program header. */
+};
+
+/**
+	Read a 16 bit field in the byte order of the file.
+	@param p The field.
+	@param big The file is big endian.
+	@return Returns the value.
+*/
+static uint16_t elf32_u16(const uint8_t *p, bool big) {
+	return big ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+/**
+	Read a 32 bit field in the byte order of the file.
+	@param p The field.
+	@param big The file is big endian.
+	@return Returns the value.
+*/
+static uint32_t elf32_u32(const uint8_t *p, bool big) {
+	return big
+		? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+		: ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+int elf32_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high) {
+	struct filebuf fb;
+	const uint8_t *d;
+	bool big;
+	uint32_t phoff, phentsize, phnum;
+	int rc;
+
+	*image = NULL;
+
+	rc = filebuf_open(&fb, path);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	d = fb.data;
+	if (fb.size < ELF32_EHSIZE || !elf32_magic(d) || d[ELF32_EI_CLASS] != 1 || (d[ELF32_EI_DATA] != 1 && d[ELF32_EI_DATA] != 2)) {
+		LOGE("'%s' is not a 32 bit ELF file.", path);
+		filebuf_close(&fb);
+		return E_TYPE;
+	}
+
+	big = d[ELF32_EI_DATA] == 2;
+	phoff = elf32_u32(d + ELF32_E_PHOFF, big);
+	phentsize = elf32_u16(d + ELF32_E_PHENTSIZE, big);
+	phnum = elf32_u16(d + ELF32_E_PHNUM, big);
+
+	if (phnum == 0) {
+		LOGE("ELF file '%s' has no program headers, only linked executables can be loaded.", path);
+		filebuf_close(&fb);
+		return E_TYPE;
+	}
+
+	if (phentsize < ELF32_PHSIZE || phoff > fb.size || (uint64_t)phnum * phentsize > fb.size - phoff) {
+		LOGE("ELF file '%s' has a broken program header table.", path);
+		filebuf_close(&fb);
+		return E_MSGMALFORMED;
+	}
+
+	rc = image_new(image, address_low, address_high);
+	if (rc != E_NONE) {
+		filebuf_close(&fb);
+		return rc;
+	}
+
+	for (uint32_t i = 0; rc == E_NONE && i < phnum; i++) {
+		const uint8_t *ph = d + phoff + i * phentsize;
+		uint32_t offset = elf32_u32(ph + ELF32_P_OFFSET, big);
+		uint32_t paddr = elf32_u32(ph + ELF32_P_PADDR, big);
+		uint32_t filesz = elf32_u32(ph + ELF32_P_FILESZ, big);
+
+		if (elf32_u32(ph + ELF32_P_TYPE, big) != ELF32_PT_LOAD || filesz == 0) {
+			continue;
+		}
+
+		if (offset > fb.size || filesz > fb.size - offset) {
+			LOGE("Segment %u of ELF file '%s' is truncated.", i, path);
+			rc = E_MSGMALFORMED;
+		} else if (paddr < address_low || (uint64_t)paddr + filesz - 1 > address_high) {
+			LOGE("Segment %u of ELF file '%s' at 0x%06X - 0x%06X is outside of (0x%06X - 0x%06X).", i, path, paddr, paddr + filesz - 1, address_low, address_high);
+			rc = E_RANGE;
+		} else {
+			rc = image_write(*image, paddr, d + offset, filesz);
+			if (rc == E_MISMATCH) {
+				LOGE("Segment %u of ELF file '%s' overlaps another segment.", i, path);
+			}
+		}
+	}
+
+	filebuf_close(&fb);
+
+	if (rc != E_NONE) {
+		image_free(image);
+		return rc;
+	}
+
+	image_seal(*image);
+	return E_NONE;
+}
+
+/** @} */
@@ -107,6 +107,7 @@ const char *error_names[ERROR_COUNT] = {
 	"E_SIZE",
 	"E_CORRUPT",
 	"E_CRC",
+	"E_ORDER",
 };
 
 /**
@@ -194,6 +195,7 @@ const char *error_help[ERROR_COUNT] = {
 	"Size constaint error.",
 	"Resource is corrupt.",
 	"Data checksum (or integrity) test failed.",
+	"Items are not in the required order.",
 };
 
 const char *errorstr(enum error_code code) {
@@ -0,0 +1,227 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup hex
+@{
+*/
+#include "stdafx.h"
+
+/** Shorthand for hex_digits[]. */
+#define XX HEX_INVALID
+
+const uint8_t hex_digits[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+
+#undef XX
+
+#ifdef CPU_X86
+
+/**
+	Decode 16 bytes at a time with SSE2.
+	Each character is classified as a digit or a letter with biased signed compares,
+	then pairs of nibbles are merged in 16 bit lanes and packed down to bytes.
+	@param dst Destination.
+	@param src Source digits.
+	@param size Number of bytes wanted.
+	@param sum The sum of the decoded bytes is added to this.
+	@return Returns the number of bytes decoded. Stops early in front of a bad digit.
+*/
+__attribute__((target("sse2")))
+static size_t hex_decode_sse2(uint8_t *dst, const char *src, size_t size, uint32_t *sum) {
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i a = _mm_set1_epi8('a');
+	const __m128i lower = _mm_set1_epi8(0x20);
+	const __m128i bias = _mm_set1_epi8((char)0x80);
+	const __m128i ndigits = _mm_set1_epi8((char)(0x80 + 10));
+	const __m128i nletters = _mm_set1_epi8((char)(0x80 + 6));
+	const __m128i ten = _mm_set1_epi8(10);
+	const __m128i lowbyte = _mm_set1_epi16(0x00FF);
+	__m128i acc = _mm_setzero_si128();
+	__m128i v[2];
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		int valid = 0xFFFF;
+		for (int k = 0; k < 2; k++) {
+			__m128i c = _mm_loadu_si128((const __m128i *)(src + i * 2 + k * 16));
+			__m128i d = _mm_sub_epi8(c, zero);
+			__m128i l = _mm_sub_epi8(_mm_or_si128(c, lower), a);
+			__m128i isdigit = _mm_cmplt_epi8(_mm_xor_si128(d, bias), ndigits);
+			__m128i isletter = _mm_cmplt_epi8(_mm_xor_si128(l, bias), nletters);
+
+			valid &= _mm_movemask_epi8(_mm_or_si128(isdigit, isletter));
+			__m128i nibble = _mm_or_si128(_mm_and_si128(isdigit, d), _mm_and_si128(isletter, _mm_add_epi8(l, ten)));
+
+			//Even characters are the high nibbles.
+			v[k] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibble, lowbyte), 4), _mm_srli_epi16(nibble, 8));
+		}
+
+		//Leave the bad digit to the scalar loop.
+		if (valid != 0xFFFF) break;
+
+		__m128i bytes = _mm_packus_epi16(v[0], v[1]);
+		_mm_storeu_si128((__m128i *)(dst + i), bytes);
+
+		//Horizontal byte sum for the record checksum, 64 bits per half.
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(bytes, _mm_setzero_si128()));
+	}
+
+	*sum += _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+	return i;
+}
+
+/**
+	Decode 32 bytes at a time with AVX2.
+	Same as hex_decode_sse2() but packing works per 128 bit lane so the quarters are put back in order.
+	@param dst Destination.
+	@param src Source digits.
+	@param size Number of bytes wanted.
+	@param sum The sum of the decoded bytes is added to this.
+	@return Returns the number of bytes decoded. Stops early in front of a bad digit.
+*/
+__attribute__((target("avx2")))
+static size_t hex_decode_avx2(uint8_t *dst, const char *src, size_t size, uint32_t *sum) {
+	const __m256i zero = _mm256_set1_epi8('0');
+	const __m256i a = _mm256_set1_epi8('a');
+	const __m256i lower = _mm256_set1_epi8(0x20);
+	const __m256i bias = _mm256_set1_epi8((char)0x80);
+	const __m256i ndigits = _mm256_set1_epi8((char)(0x80 + 10));
+	const __m256i nletters = _mm256_set1_epi8((char)(0x80 + 6));
+	const __m256i ten = _mm256_set1_epi8(10);
+	const __m256i lowbyte = _mm256_set1_epi16(0x00FF);
+	__m256i acc = _mm256_setzero_si256();
+	__m256i v[2];
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		int valid = -1;
+		for (int k = 0; k < 2; k++) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)(src + i * 2 + k * 32));
+			__m256i d = _mm256_sub_epi8(c, zero);
+			__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, lower), a);
+			__m256i isdigit = _mm256_cmpgt_epi8(ndigits, _mm256_xor_si256(d, bias));
+			__m256i isletter = _mm256_cmpgt_epi8(nletters, _mm256_xor_si256(l, bias));
+
+			valid &= _mm256_movemask_epi8(_mm256_or_si256(isdigit, isletter));
+			__m256i nibble = _mm256_or_si256(_mm256_and_si256(isdigit, d), _mm256_and_si256(isletter, _mm256_add_epi8(l, ten)));
+			v[k] = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nibble, lowbyte), 4), _mm256_srli_epi16(nibble, 8));
+		}
+
+		if (valid != -1) break;
+
+		__m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(v[0], v[1]), 0xD8);
+		_mm256_storeu_si256((__m256i *)(dst + i), bytes);
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+
+	*sum += _mm256_extract_epi32(acc, 0) + _mm256_extract_epi32(acc, 2) + _mm256_extract_epi32(acc, 4) + _mm256_extract_epi32(acc, 6);
+	return i;
+}
+
+#endif //CPU_X86
+
+int hex_field(const char *s, int bytes, uint32_t *value) {
+	uint32_t v = 0;
+	int b;
+
+	for (int i = 0; i < bytes; i++, s += 2) {
+		b = hex_byte(s);
+		if (b < 0) {
+			return E_INVALID;
+		}
+		v = (v << 8) | b;
+	}
+
+	*value = v;
+	return E_NONE;
+}
+
+int hex_decode(uint8_t *dst, const char *src, size_t size, uint8_t *psum) {
+	uint32_t sum = 0;
+	size_t i = 0;
+	int b;
+
+#ifdef CPU_X86
+	enum cpu_level level = cpu_level();
+
+	if (level == CPU_LEVEL_AVX2) {
+		i = hex_decode_avx2(dst, src, size, &sum);
+	}
+
+	if (level >= CPU_LEVEL_SSE2) {
+		i += hex_decode_sse2(dst + i, src + i * 2, size - i, &sum);
+	}
+#endif
+
+	//Leftovers, or the bad digit a vector path stopped at.
+	for (; i < size; i++) {
+		b = hex_byte(src + i * 2);
+		if (b < 0) {
+			return E_INVALID;
+		}
+		dst[i] = b;
+		sum += b;
+	}
+
+	if (psum) *psum += sum;
+	return E_NONE;
+}
+
+/** Two uppercase digits for every byte value, looked up by hex_encode(). */
+static const char hex_pairs[2 * 256 + 1] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+void hex_encode(char *dst, const uint8_t *src, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		memcpy(dst + i * 2, hex_pairs + src[i] * 2, 2);
+	}
+}
+
+/** @} */
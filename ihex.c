@@ -0,0 +1,203 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup ihex
+@{
+*/
+#include "stdafx.h"
+
+/** Bytes in the longest record: count, address, type, 255 data bytes and checksum. */
+#define IHEX_MAXBYTES (1 + 2 + 1 + 255 + 1)
+
+/** Loader state carried from one record to the next. */
+struct ihex_state {
+	struct image *image;	/**< Image being loaded. */
+	const char *path;		/**< Name of the source for messages. */
+	uint32_t base;			/**< Base address from the last record 02 or 04. */
+	uint32_t address_low;	/**< Lower bound for address check. */
+	uint32_t address_high;	/**< Upper bound for address check. */
+	bool eof;				/**< Record 01 was seen. */
+};
+
+/**
+	Copy data into the image, checking the bounds.
+	@param st Loader state.
+	@param address Address of data[0].
+	@param data The data.
+	@param size Number of bytes in data[].
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int ihex_place(struct ihex_state *st, uint32_t address, const uint8_t *data, uint32_t size) {
+	if (address < st->address_low || (uint64_t)address + size - 1 > st->address_high) {
+		LOGE("Intel HEX in '%s' has out of bounds data. Address 0x%06X is outside of (0x%06X - 0x%06X).", st->path, address, st->address_low, st->address_high);
+		return E_RANGE;
+	}
+
+	int rc = image_write(st->image, address, data, size);
+	if (rc == E_MISMATCH) {
+		LOGE("Intel HEX at 0x%06X in '%s' overwrites earlier data with different values.", address, st->path);
+	}
+
+	return rc;
+}
+
+/**
+	Parse one trimmed line and apply it.
+	@param st Loader state.
+	@param s First character of the line.
+	@param end One past the last character.
+	@return On success, returns E_NONE.
+	@return If the line is malformed or fails its checksum, returns E_MSGMALFORMED or E_CRC.
+	@return On failure, returns a negative error code.
+*/
+static int ihex_parse(struct ihex_state *st, const char *s, const char *end) {
+	uint8_t rec[IHEX_MAXBYTES];
+	uint8_t sum = 0;
+	int count;
+	uint32_t offset;
+
+	if (end - s < 11 || *s != ':') {
+		return E_MSGMALFORMED;
+	}
+
+	count = hex_byte(s + 1);
+	if (count < 0 || end - s != 11 + count * 2) {
+		return E_MSGMALFORMED;
+	}
+
+	//Every byte including the checksum sums up to zero.
+	if (hex_decode(rec, s + 1, 5 + count, &sum) != E_NONE) {
+		return E_MSGMALFORMED;
+	}
+	if (sum != 0) {
+		return E_CRC;
+	}
+
+	offset = (rec[1] << 8) | rec[2];
+
+	switch (rec[3]) {
+		case IHEX_DATA:
+			if (count == 0) {
+				return E_NONE;
+			}
+
+			//The offset wraps around within 64 KiB.
+			if (offset + count > 0x10000) {
+				uint32_t first = 0x10000 - offset;
+				int rc = ihex_place(st, st->base + offset, rec + 4, first);
+				if (rc != E_NONE) {
+					return rc;
+				}
+				return ihex_place(st, st->base, rec + 4 + first, count - first);
+			}
+			return ihex_place(st, st->base + offset, rec + 4, count);
+
+		case IHEX_EOF:
+			st->eof = true;
+			return E_NONE;
+
+		case IHEX_SEGMENT:
+			if (count != 2) return E_MSGMALFORMED;
+			st->base = ((rec[4] << 8) | rec[5]) << 4;
+			return E_NONE;
+
+		case IHEX_LINEAR:
+			if (count != 2) return E_MSGMALFORMED;
+			st->base = (uint32_t)((rec[4] << 8) | rec[5]) << 16;
+			return E_NONE;
+
+		case IHEX_STARTSEGMENT:
+		case IHEX_STARTLINEAR:
+			return E_NONE;
+	}
+
+	return E_MSGMALFORMED;
+}
+
+int ihex_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high) {
+	struct ihex_state st;
+	struct filebuf fb;
+	const char *s, *end, *eol, *last;
+	int linecount = 0;
+	int rc;
+
+	*image = NULL;
+
+	rc = filebuf_open(&fb, path);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	rc = image_new(image, address_low, address_high);
+	if (rc != E_NONE) {
+		filebuf_close(&fb);
+		return rc;
+	}
+
+	memset(&st, 0x00, sizeof(st));
+	st.image = *image;
+	st.path = path;
+	st.address_low = address_low;
+	st.address_high = address_high;
+
+	s = (const char *)fb.data;
+	end = s + fb.size;
+	while (rc == E_NONE && !st.eof && s < end) {
+		eol = memchr(s, '\n', end - s);
+		if (eol == NULL) eol = end;
+
+		linecount++;
+
+		//Trim both ends in place.
+		last = eol;
+		while (s < last && isspace((uint8_t)*s)) s++;
+		while (last > s && isspace((uint8_t)last[-1])) last--;
+
+		if (last > s) {
+			rc = ihex_parse(&st, s, last);
+		}
+
+		s = eol + 1;
+	}
+
+	filebuf_close(&fb);
+
+	if (rc == E_CRC) {
+		LOGE("Line %d in '%s' has invalid checksum.", linecount, path);
+		rc = E_ERROR;
+	} else if (rc == E_MSGMALFORMED) {
+		LOGE("Line %d in '%s' is not a valid Intel HEX record.", linecount, path);
+		rc = E_ERROR;
+	}
+
+	if (rc != E_NONE) {
+		image_free(image);
+		return rc;
+	}
+
+	if ((*image)->noverlap > 0) {
+		LOGW("%u bytes in '%s' are given more than once, with the same values.", (*image)->noverlap, path);
+	}
+
+	image_seal(*image);
+	return E_NONE;
+}
+
+/** @} */
@@ -0,0 +1,473 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup image
+@{
+*/
+#include "stdafx.h"
+
+int image_new(struct image **image, uint32_t address_low, uint32_t address_high) {
+	assert(image);
+
+	*image = NULL;
+
+	if (address_low > address_high) {
+		return E_ARGUMENT;
+	}
+
+	struct image *img = (struct image *)calloc(1, sizeof(struct image));
+	assert(img);
+
+	img->base = address_low & ~(IMAGE_BLOCK - 1);
+	img->nblocks = (address_high - img->base) / IMAGE_BLOCK + 1;
+	img->end = img->base + img->nblocks * IMAGE_BLOCK;
+	img->blocks = (uint8_t **)calloc(img->nblocks, sizeof(uint8_t *));
+	assert(img->blocks);
+	img->covered = (uint64_t **)calloc(img->nblocks, sizeof(uint64_t *));
+	assert(img->covered);
+	img->nonempty = (uint32_t *)calloc((img->nblocks + 31) / 32, sizeof(uint32_t));
+	assert(img->nonempty);
+	img->crcs = (uint16_t *)calloc(img->nblocks, sizeof(uint16_t));
+	assert(img->crcs);
+
+	uint8_t blank[IMAGE_BLOCK];
+	memset(blank, 0xFF, sizeof(blank));
+	img->blankcrc = crcitt(blank, sizeof(blank));
+
+	*image = img;
+	return E_NONE;
+}
+
+void image_free(struct image **image) {
+	if (image && *image) {
+		if ((*image)->map) {
+			//Everything but the page table lives in the mapped file.
+			fileunmap((*image)->map, (*image)->maplen);
+		} else {
+			for (uint32_t i = 0; i < (*image)->nblocks; i++) {
+				free((*image)->blocks[i]);
+				free((*image)->covered[i]);
+			}
+			free((*image)->covered);
+			free((*image)->nonempty);
+			free((*image)->crcs);
+		}
+		free((*image)->blocks);
+		free(*image);
+		*image = NULL;
+	}
+}
+
+/**
+	Select the bits of one coverage word that fall within a byte range of a block.
+	@param from First byte of the range.
+	@param to One past the last byte of the range.
+	@param w Index of the word.
+	@return Returns the bit mask.
+*/
+static uint64_t image_bits(uint32_t from, uint32_t to, uint32_t w) {
+	uint32_t lo = w * 64;
+	uint32_t hi = lo + 64;
+
+	if (from > lo) lo = from;
+	if (to < hi) hi = to;
+	if (lo >= hi) return 0;
+
+	return ((hi - lo == 64) ? ~0ULL : ((1ULL << (hi - lo)) - 1)) << (lo - w * 64);
+}
+
+int image_write(struct image *image, uint32_t address, const uint8_t *data, uint32_t size) {
+	uint32_t index, offset, chunk;
+	uint8_t *block;
+	uint64_t *mask;
+	uint64_t bits;
+	bool clear;
+
+	if (image->map) {
+		return E_ACCESS;
+	}
+
+	if (size == 0) {
+		return E_NONE;
+	}
+
+	image->sealed = false;
+	image->hashed = false;
+
+	if (address < image->base || address - image->base + size > image->nblocks * IMAGE_BLOCK) {
+		return E_RANGE;
+	}
+
+	while (size > 0) {
+		index = (address - image->base) / IMAGE_BLOCK;
+		offset = (address - image->base) % IMAGE_BLOCK;
+		chunk = IMAGE_BLOCK - offset;
+		if (chunk > size) chunk = size;
+
+		//Fresh blocks start out erased.
+		if (image->blocks[index] == NULL) {
+			image->blocks[index] = (uint8_t *)malloc(IMAGE_BLOCK);
+			assert(image->blocks[index]);
+			memset(image->blocks[index], 0xFF, IMAGE_BLOCK);
+			image->covered[index] = (uint64_t *)calloc(IMAGE_BLOCK / 64, sizeof(uint64_t));
+			assert(image->covered[index]);
+			image->nused++;
+		}
+
+		block = image->blocks[index];
+		mask = image->covered[index];
+
+		//Usually nothing was there before, copy it in one go.
+		clear = true;
+		for (uint32_t w = offset / 64; w <= (offset + chunk - 1) / 64; w++) {
+			if (mask[w] & image_bits(offset, offset + chunk, w)) clear = false;
+		}
+
+		if (clear) {
+			memcpy(block + offset, data, chunk);
+			for (uint32_t w = offset / 64; w <= (offset + chunk - 1) / 64; w++) {
+				mask[w] |= image_bits(offset, offset + chunk, w);
+			}
+		} else {
+			for (uint32_t i = 0, o = offset; i < chunk; i++, o++) {
+				bits = 1ULL << (o % 64);
+				if (mask[o / 64] & bits) {
+					if (block[o] != data[i]) {
+						return E_MISMATCH;
+					}
+					image->noverlap++;
+				} else {
+					mask[o / 64] |= bits;
+					block[o] = data[i];
+				}
+			}
+		}
+
+		address += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+
+	return E_NONE;
+}
+
+void image_seal(struct image *image) {
+	if (image->map) {
+		return;
+	}
+
+	memset(image->nonempty, 0x00, (image->nblocks + 31) / 32 * sizeof(uint32_t));
+	image->nfull = 0;
+
+	for (uint32_t i = 0; i < image->nblocks; i++) {
+		if (image->blocks[i] == NULL || blank_isempty(image->blocks[i], IMAGE_BLOCK)) {
+			image->crcs[i] = image->blankcrc;
+			continue;
+		}
+
+		image->nonempty[i / 32] |= (1u << (i % 32));
+		image->crcs[i] = crcitt(image->blocks[i], IMAGE_BLOCK);
+		image->nfull++;
+	}
+
+	image->sealed = true;
+}
+
+const uint8_t *image_block(struct image *image, uint32_t address) {
+	if (address < image->base || address >= image->end) {
+		return NULL;
+	}
+	return image->blocks[(address - image->base) / IMAGE_BLOCK];
+}
+
+bool image_isempty(struct image *image, uint32_t address) {
+	assert(image->sealed);
+
+	if (address < image->base || address >= image->end) {
+		return true;
+	}
+
+	uint32_t i = (address - image->base) / IMAGE_BLOCK;
+	return (image->nonempty[i / 32] & (1u << (i % 32))) == 0;
+}
+
+uint16_t image_crc(struct image *image, uint32_t address) {
+	assert(image->sealed);
+
+	if (address < image->base || address >= image->end) {
+		return image->blankcrc;
+	}
+
+	return image->crcs[(address - image->base) / IMAGE_BLOCK];
+}
+
+uint32_t image_next(struct image *image, uint32_t address) {
+	assert(image->sealed);
+
+	if (address < image->base) {
+		address = image->base;
+	}
+	if (address >= image->end) {
+		return image->end;
+	}
+
+	//Skip a word of the bitmap at a time.
+	uint32_t i = (address - image->base) / IMAGE_BLOCK;
+	uint32_t word = image->nonempty[i / 32] & (0xFFFFFFFFu << (i % 32));
+	uint32_t w = i / 32;
+	uint32_t nwords = (image->nblocks + 31) / 32;
+
+	while (word == 0) {
+		if (++w >= nwords) {
+			return image->end;
+		}
+		word = image->nonempty[w];
+	}
+
+	return image->base + (w * 32 + __builtin_ctz(word)) * IMAGE_BLOCK;
+}
+
+int image_readbinary(struct image **image, const char *path, uint32_t address, uint32_t address_low, uint32_t address_high) {
+	struct filebuf fb;
+	size_t off, chunk;
+	int rc;
+
+	*image = NULL;
+
+	rc = filebuf_open(&fb, path);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	if (fb.size > 0 && (address < address_low || (uint64_t)address + fb.size - 1 > address_high)) {
+		LOGE("Binary '%s' of %u bytes at 0x%06X is outside of (0x%06X - 0x%06X).", path, (unsigned)fb.size, address, address_low, address_high);
+		filebuf_close(&fb);
+		return E_RANGE;
+	}
+
+	rc = image_new(image, address_low, address_high);
+
+	//Only blocks that hold data are allocated, the erased parts of a dump cost nothing.
+	for (off = blank_span(fb.data, fb.size); rc == E_NONE && off < fb.size; off += blank_span(fb.data + off, fb.size - off)) {
+		chunk = IMAGE_BLOCK - (address + off - (*image)->base) % IMAGE_BLOCK;
+		if (chunk > fb.size - off) {
+			chunk = fb.size - off;
+		}
+
+		rc = image_write(*image, address + off, fb.data + off, chunk);
+		off += chunk;
+	}
+	filebuf_close(&fb);
+
+	if (rc != E_NONE) {
+		image_free(image);
+		return rc;
+	}
+
+	image_seal(*image);
+	return E_NONE;
+}
+
+void image_hash(struct image *image, uint8_t *digest) {
+	struct sha256 ctx;
+	uint8_t be[4];
+
+	if (!image->hashed) {
+		sha256_init(&ctx);
+		for (uint32_t addr = image_next(image, image->base); addr < image->end; addr = image_next(image, addr + IMAGE_BLOCK)) {
+			be[0] = addr >> 24;
+			be[1] = addr >> 16;
+			be[2] = addr >> 8;
+			be[3] = addr;
+			sha256_update(&ctx, be, sizeof(be));
+			sha256_update(&ctx, image_block(image, addr), IMAGE_BLOCK);
+		}
+		sha256_final(&ctx, image->hash);
+		image->hashed = true;
+	}
+
+	memcpy(digest, image->hash, SHA256_SIZE);
+}
+
+/**
+	Compute where the sections of a compiled image file start.
+	@param nblocks Number of blocks in the image.
+	@param pcrcs Assigned the offset of the CRC table.
+	@param pdata Assigned the offset of the first payload.
+*/
+static void image_layout(uint32_t nblocks, size_t *pcrcs, size_t *pdata) {
+	size_t bitmap = sizeof(struct image_header);
+
+	*pcrcs = (bitmap + (nblocks + 31) / 32 * sizeof(uint32_t) + 7) & ~(size_t)7;
+	*pdata = (*pcrcs + nblocks * sizeof(uint16_t) + 7) & ~(size_t)7;
+}
+
+int image_save(struct image *image, const char *path, const char *mcu) {
+	FILE *F;
+	bool ok;
+
+	F = fopen(path, "wb");
+	if (F == NULL) {
+		LOGE("Could not open '%s' for writing.", path);
+		return E_OPEN;
+	}
+
+	ok = image_savestream(image, F, mcu) == E_NONE;
+
+	if (fclose(F) != 0) {
+		ok = false;
+	}
+
+	if (!ok) {
+		LOGE("Could not write image to '%s'.", path);
+		remove(path);
+		return E_WRITE;
+	}
+
+	return E_NONE;
+}
+
+int image_savestream(struct image *image, FILE *F, const char *mcu) {
+	struct image_header hdr;
+	size_t crcs, data, pos;
+	uint8_t zero[8] = {0};
+	bool ok;
+
+	assert(image->sealed);
+
+	memset(&hdr, 0x00, sizeof(hdr));
+	memcpy(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic));
+	hdr.version = IMAGE_VERSION;
+	hdr.headersize = sizeof(hdr);
+	strncpy(hdr.mcu, mcu ? mcu : "", sizeof(hdr.mcu) - 1);
+	hdr.base = image->base;
+	hdr.nblocks = image->nblocks;
+	hdr.nfull = image->nfull;
+	image_hash(image, hdr.hash);
+
+	image_layout(image->nblocks, &crcs, &data);
+
+	pos = sizeof(hdr) + (image->nblocks + 31) / 32 * sizeof(uint32_t);
+	ok = fwrite(&hdr, sizeof(hdr), 1, F) == 1;
+	ok = ok && fwrite(image->nonempty, sizeof(uint32_t), (image->nblocks + 31) / 32, F) == (image->nblocks + 31) / 32;
+	ok = ok && fwrite(zero, 1, crcs - pos, F) == crcs - pos;
+
+	pos = crcs + image->nblocks * sizeof(uint16_t);
+	ok = ok && fwrite(image->crcs, sizeof(uint16_t), image->nblocks, F) == image->nblocks;
+	ok = ok && fwrite(zero, 1, data - pos, F) == data - pos;
+
+	for (uint32_t addr = image_next(image, image->base); ok && addr < image->end; addr = image_next(image, addr + IMAGE_BLOCK)) {
+		ok = fwrite(image_block(image, addr), IMAGE_BLOCK, 1, F) == 1;
+	}
+
+	return ok ? E_NONE : E_WRITE;
+}
+
+int image_load(struct image **image, const char *path, char *mcu) {
+	const struct image_header *hdr;
+	const uint8_t *map;
+	size_t len, crcs, data;
+	uint32_t nwords, count;
+
+	assert(image);
+
+	*image = NULL;
+
+	map = filemap(path, &len);
+	if (map == NULL) {
+		LOGE("Could not open '%s' for reading.", path);
+		return E_OPEN;
+	}
+
+	hdr = (const struct image_header *)map;
+	if (len < sizeof(*hdr) || !image_probe((const uint8_t *)hdr->magic)
+		|| hdr->version != IMAGE_VERSION || hdr->headersize != sizeof(*hdr)) {
+		LOGE("'%s' is not a compiled image of version %d.", path, IMAGE_VERSION);
+		fileunmap(map, len);
+		return E_TYPE;
+	}
+
+	//Everything below is used without further checks, so check it all now.
+	nwords = (hdr->nblocks + 31) / 32;
+	if (hdr->nblocks == 0 || hdr->base % IMAGE_BLOCK != 0
+		|| (uint64_t)hdr->base + (uint64_t)hdr->nblocks * IMAGE_BLOCK > 0x100000000ULL) {
+		LOGE("Compiled image '%s' is truncated or corrupt.", path);
+		fileunmap(map, len);
+		return E_MSGMALFORMED;
+	}
+
+	image_layout(hdr->nblocks, &crcs, &data);
+	if (hdr->nfull > hdr->nblocks || len != data + (size_t)hdr->nfull * IMAGE_BLOCK) {
+		LOGE("Compiled image '%s' is truncated or corrupt.", path);
+		fileunmap(map, len);
+		return E_MSGMALFORMED;
+	}
+
+	const uint32_t *nonempty = (const uint32_t *)(map + sizeof(*hdr));
+	count = 0;
+	for (uint32_t w = 0; w < nwords; w++) {
+		count += __builtin_popcount(nonempty[w]);
+	}
+	if (count != hdr->nfull || (hdr->nblocks % 32 && (nonempty[nwords - 1] >> (hdr->nblocks % 32)) != 0)) {
+		LOGE("Compiled image '%s' is truncated or corrupt.", path);
+		fileunmap(map, len);
+		return E_MSGMALFORMED;
+	}
+
+	struct image *img = (struct image *)calloc(1, sizeof(struct image));
+	assert(img);
+
+	img->base = hdr->base;
+	img->nblocks = hdr->nblocks;
+	img->end = img->base + img->nblocks * IMAGE_BLOCK;
+	img->nfull = hdr->nfull;
+	img->nused = hdr->nfull;
+	img->nonempty = (uint32_t *)nonempty;
+	img->crcs = (uint16_t *)(map + crcs);
+	img->map = map;
+	img->maplen = len;
+	memcpy(img->hash, hdr->hash, SHA256_SIZE);
+	img->hashed = true;
+
+	uint8_t blank[IMAGE_BLOCK];
+	memset(blank, 0xFF, sizeof(blank));
+	img->blankcrc = crcitt(blank, sizeof(blank));
+
+	//Point the page table at the payloads.
+	img->blocks = (uint8_t **)calloc(img->nblocks, sizeof(uint8_t *));
+	assert(img->blocks);
+	const uint8_t *payload = map + data;
+	for (uint32_t i = 0; i < img->nblocks; i++) {
+		if (nonempty[i / 32] & (1u << (i % 32))) {
+			img->blocks[i] = (uint8_t *)payload;
+			payload += IMAGE_BLOCK;
+		}
+	}
+	img->sealed = true;
+
+	if (mcu) {
+		memcpy(mcu, hdr->mcu, sizeof(hdr->mcu));
+		mcu[sizeof(hdr->mcu) - 1] = '\0';
+	}
+
+	*image = img;
+	return E_NONE;
+}
+
+/** @} */
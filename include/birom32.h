@@ -64,6 +64,70 @@ struct birom32_state {
 	long kernalsize;			/**< Size of kernal file. */
 };
 
+/** Enumeration of the phases a non-blocking birom32 operation goes through. */
+enum birom32_phase {
+	BIROM32_PHASE_IDLE = 0,		/**< No operation has been started. */
+	BIROM32_PHASE_COMMAND,		/**< Command bytes are waiting to be sent. */
+	BIROM32_PHASE_PREAMBLE,		/**< Waiting for the acknowledge to the command. */
+	BIROM32_PHASE_PAYLOAD,		/**< Sending the size and data of a write. */
+	BIROM32_PHASE_TRAILER,		/**< Waiting for checksum or final confirmation. */
+	BIROM32_PHASE_DONE,			/**< Operation has finished, see result. */
+};
+
+/**
+	Non-blocking birom32 state machine.
+	Works like struct kernal32_machine: the caller sends tx[], feeds received bytes into
+	birom32_step() and calls it again no later than at deadline.
+*/
+struct birom32_machine {
+	enum birom32_cmdid cmd;		/**< Command in progress. */
+	enum birom32_phase phase;	/**< Where we are in the command. */
+	uint32_t address;			/**< RAM address of write or call. */
+	uint8_t *data;				/**< Data to write. */
+	uint32_t size;				/**< Number of bytes in data[]. */
+	uint16_t csum;				/**< Checksum of data[] as computed by us. */
+	uint8_t cmdbuf[8];			/**< Storage for outgoing command bytes. */
+	uint8_t rx[4];				/**< Storage for incoming checksum. */
+	int rxlen;					/**< Number of bytes in rx[]. */
+	uint8_t *tx;				/**< Next bytes the caller must send. */
+	int txlen;					/**< Number of bytes remaining in tx[]. */
+	double deadline;			/**< Call birom32_step() at this get_ticks() time at the latest. */
+	double timeout;				/**< The operation fails with E_TIMEOUT at this get_ticks() time. Caller may extend it after birom32_begin(). */
+	int result;					/**< E_WOULDBLOCK while busy, then the final result. */
+};
+
+/**
+	Start a non-blocking birom32 operation.
+	BIROM32_CMD_PROBE is repeated until the MCU answers or the time-out, 5 seconds by default, passes.
+	@param m State machine. Must not be busy with another operation.
+	@param cmd The command to run.
+	@param address RAM address for BIROM32_CMD_WRITE and BIROM32_CMD_CALL.
+	@param data Data for BIROM32_CMD_WRITE, otherwise NULL.
+	@param size Number of bytes in data[]. At most 65535.
+	@param now Current time from get_ticks().
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int birom32_begin(struct birom32_machine *m, enum birom32_cmdid cmd, uint32_t address, uint8_t *data, uint32_t size, double now);
+
+/**
+	Advance a non-blocking birom32 operation.
+	@param m State machine.
+	@param rx Received bytes, can be NULL.
+	@param rxlen Number of bytes in rx[].
+	@param now Current time from get_ticks().
+	@return While the operation is in progress, returns E_WOULDBLOCK.
+	@return When done, returns E_NONE or a negative error code.
+*/
+int birom32_step(struct birom32_machine *m, const uint8_t *rx, int rxlen, double now);
+
+/**
+	Tell the machine that the caller has sent some of the pending tx[] bytes.
+	@param m State machine.
+	@param n Number of bytes sent.
+*/
+void birom32_sent(struct birom32_machine *m, int n);
+
 /**
 	Allocate for a new birom32 state and initialize connection to the given serial port at the given baud rate.
 	@param state The dereferenced pointer is assigned to the newly allocated state.
@@ -100,11 +164,13 @@ int birom32_check(struct birom32_state *state);
 /**
 	Write size number of bytes to memory address in RAM.
 	Ideal to dump flash loader executable.
+	The data is sent as is in SERIAL_TXCHUNK pieces and checksummed on the way.
 	@param state The birom32 state.
 	@param address Memory address.
 	@param data Array of the bytes to write.
-	@param size Number of bytes to write.
+	@param size Number of bytes to write. At most 65535, the ROM takes a 16 bit size.
 	@return On success, returns the number of bytes written.
+	@return If size is too large, returns E_RANGE.
 	@return On failure, returns a negative error code.
 */
 int birom32_write(struct birom32_state *state, uint32_t address, uint8_t *data, uint32_t size);
@@ -0,0 +1,47 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Erased flash detection.
+Erased flash reads as 0xFF, so finding data means finding the first byte that is not 0xFF.
+Buffers are scanned 32 or 16 bytes at a time with AVX2 or SSE2 when the CPU has them,
+8 bytes at a time otherwise. The instruction set is picked once, on first use.
+@defgroup blank Erased Flash Detection
+@{
+*/
+#ifndef __BLANK_H__
+#define __BLANK_H__
+
+/**
+	Count the erased bytes at the start of a buffer.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@return Returns the offset of the first byte that is not 0xFF, size if there is none.
+*/
+size_t blank_span(const uint8_t *buf, size_t size);
+
+/**
+	Test if a buffer only holds erased flash.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@return If all bytes are 0xFF, returns true.
+*/
+bool blank_isempty(const uint8_t *buf, size_t size);
+
+#endif //__BLANK_H__
+/** @} */
@@ -0,0 +1,64 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+On-disk cache of parsed images.
+Parsing a large S-Record or Intel HEX file is by far the slowest part of loading, and production
+stations write the same file over and over. The cache keeps every parsed file as a
+compiled image (see image_save()) named by the SHA-256 of the file contents, the MCU
+and the flash range, so a changed file can never hit a stale entry.
+
+Hashing the contents still reads the whole file. To skip that too, a small reference
+file named by the file identity (device, inode, size and modification time) records
+which entry it parsed into. A reference is only written once the file has been left
+alone for a couple of seconds, so a quick rewrite within one timestamp tick can not
+be mistaken for the old contents.
+
+@verbatim
+<dir>/<content key>.k32	Compiled image.
+<dir>/<identity key>.ref	Content key of the file with that identity.
+@endverbatim
+
+@defgroup cache Parsed Image Cache
+@{
+*/
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+/** A text file loader such as srec_readimage() or ihex_readimage(). */
+typedef int (*cache_reader)(struct image **image, const char *path, uint32_t address_low, uint32_t address_high);
+
+/**
+	Load a text file through the cache.
+	On a miss the file is parsed with reader and the result is added to the cache.
+	The format is known from the contents, so the content key needs no reader of its own.
+	Files that can not be mapped, such as standard input, bypass the cache.
+	@param image The dereferenced pointer is assigned to the loaded image.
+	@param dir Cache directory. Created if it does not exist.
+	@param path Path to the file.
+	@param reader Loader for the format of the file.
+	@param mcu Name of the MCU.
+	@param address_low First address of the flash.
+	@param address_high Last address of the flash, inclusive.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int cache_readimage(struct image **image, const char *dir, const char *path, cache_reader reader, const char *mcu, uint32_t address_low, uint32_t address_high);
+
+#endif //__CACHE_H__
+/** @} */
@@ -0,0 +1,107 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Block level comparison of two flash images.
+Blocks are compared by their CRCs first, which sealed images already hold, and only the
+blocks that differ or whose CRCs collide are compared byte by byte. Blocks that are
+erased in both images are skipped a bitmap word at a time.
+The result tells which block ranges changed, by how many bytes, and roughly how long
+programming the new image would take over the serial line.
+Two @link manifest manifests @endlink can be compared the same way without any payload,
+then only the changed blocks are known, not how many bytes in them changed.
+@defgroup diff Image Diff
+@{
+*/
+#ifndef __DIFF_H__
+#define __DIFF_H__
+
+/** Bytes on the line per block written: command, address, data, CRC and acknowledge. */
+#define DIFF_FRAME (4 + IMAGE_BLOCK + 2 + 2)
+
+/** Bits on the line per byte with 8N1 framing. */
+#define DIFF_BITS 10
+
+/** A run of adjacent changed blocks. */
+struct diff_range {
+	uint32_t start;		/**< Address of the first block. */
+	uint32_t end;		/**< One past the last block. */
+	uint32_t nbytes;	/**< Number of bytes that differ in the range. */
+};
+
+/** Result of diff_images() or diff_manifests(). */
+struct diff {
+	uint32_t nblocks;			/**< Number of blocks in the compared range. */
+	uint32_t nchanged;			/**< Number of blocks that differ. */
+	uint32_t nbytes;			/**< Number of bytes that differ. Only valid when exact. */
+	uint32_t nprogram;			/**< Number of blocks that hold data in the new image, what a full re-flash writes. */
+	uint32_t nranges;			/**< Number of entries in ranges[]. */
+	uint32_t maxranges;			/**< Allocated entries in ranges[]. */
+	struct diff_range *ranges;	/**< Changed block ranges in address order. */
+	bool exact;					/**< Payloads were compared, so byte counts are known. */
+};
+
+/**
+	Compare two sealed images.
+	The compared range covers both images, blocks outside an image read as erased.
+	@param diff The dereferenced pointer is assigned to the result.
+	@param from The image that is there now, e.g. read from the MCU.
+	@param to The image that would replace it.
+	@return On success, returns E_NONE.
+	@return If the blocks of the images are not aligned to each other, returns E_RANGE with *diff assigned NULL.
+*/
+int diff_images(struct diff **diff, struct image *from, struct image *to);
+
+/**
+	Compare two manifests by block CRC alone.
+	A 16 bit CRC can collide, so when every CRC matches the image hashes must match too.
+	@param diff The dereferenced pointer is assigned to the result.
+	@param from Manifest of what is there now.
+	@param to Manifest of what would replace it.
+	@return On success, returns E_NONE.
+	@return If the blocks of the manifests are not aligned to each other, returns E_RANGE with *diff assigned NULL.
+	@return If the CRCs match but the hashes do not, returns E_MISMATCH with *diff assigned NULL. Compare the images instead.
+*/
+int diff_manifests(struct diff **diff, struct manifest *from, struct manifest *to);
+
+/**
+	Estimate how long writing blocks takes.
+	Only the serial transfer is counted, not the time the flash takes to program or erase.
+	@param nblocks Number of blocks to write.
+	@param baud Baud rate of the kernal32 connection.
+	@return Returns the estimate in seconds.
+*/
+double diff_seconds(uint32_t nblocks, uint32_t baud);
+
+/**
+	Log the changed ranges, the totals and the programming time estimates.
+	@param diff Result of diff_images() or diff_manifests().
+	@param from Name of the image that is there now.
+	@param to Name of the image that would replace it.
+	@param baud Baud rate of the kernal32 connection.
+*/
+void diff_print(struct diff *diff, const char *from, const char *to, uint32_t baud);
+
+/**
+	Free a diff.
+	@param diff The dereferenced pointer is freed and assigned NULL.
+*/
+void diff_free(struct diff **diff);
+
+#endif //__DIFF_H__
+/** @} */
@@ -0,0 +1,60 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ELF loader.
+Loads the PT_LOAD segments of a 32 bit ELF executable, big or little endian, into a sparse
+@link image @endlink at their physical (load) addresses. Initialized data whose run-time
+address is in RAM is thereby programmed where the startup code copies it from.
+Segments without file contents such as .bss are skipped.
+@defgroup elf32 ELF Executable
+@{
+*/
+#ifndef __ELF32_H__
+#define __ELF32_H__
+
+/** Size of the ELF identification bytes. */
+#define ELF32_NIDENT 16
+
+/** Segment type of a loadable segment. */
+#define ELF32_PT_LOAD 1
+
+/**
+	Test if data starts with the ELF magic.
+	@param data At least 4 bytes.
+	@return If it is an ELF file, returns true.
+*/
+static inline bool elf32_magic(const uint8_t *data) {
+	return data[0] == 0x7F && data[1] == 'E' && data[2] == 'L' && data[3] == 'F';
+}
+
+/**
+	Load the PT_LOAD segments of an ELF file into an image covering an address range.
+	@param image The dereferenced pointer is assigned to the new, sealed image.
+	@param path Path to the file, "-" for standard input.
+	@param address_low First address of the flash.
+	@param address_high Last address of the flash, inclusive.
+	@return On success, returns E_NONE.
+	@return If the file is not a 32 bit ELF file, returns E_TYPE.
+	@return If a segment falls outside the range, returns E_RANGE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int elf32_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high);
+
+#endif //__ELF32_H__
+/** @} */
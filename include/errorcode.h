@@ -107,8 +107,9 @@ enum error_code {
 	E_SIZE				= -77,	/**< Size constaint error. */
 	E_CORRUPT			= -78,	/**< Resource is corrupt. */
 	E_CRC				= -79,	/**< Data checksum (or integrity) test failed. */
+	E_ORDER				= -80,	/**< Items are not in the required order. */
 	//--
-	ERROR_COUNT			= 80	/**< Total number of error codes. Used to size arrays etc. */
+	ERROR_COUNT			= 81	/**< Total number of error codes. Used to size arrays etc. */
 };
 
 /**
@@ -0,0 +1,77 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Hexadecimal text to binary conversion and back.
+A 256 entry table serves single digits, whole fields are decoded with SSE2 or AVX2 when the CPU has them.
+Unlike the old hexval() a bad digit is always reported, never turned into 0.
+@defgroup hex Hex Decoding
+@{
+*/
+#ifndef __HEX_H__
+#define __HEX_H__
+
+/** Marks a character that is not a hexadecimal digit in hex_digits[]. */
+#define HEX_INVALID 0xFF
+
+/** Value of every character as a hexadecimal digit, HEX_INVALID if it is not one. */
+extern const uint8_t hex_digits[256];
+
+/**
+	Decode one byte from two hexadecimal digits.
+	@param s The two digits, most significant first.
+	@return On success, returns the value 0 - 255.
+	@return If either digit is invalid, returns -1.
+*/
+static inline int hex_byte(const char *s) {
+	uint8_t hi = hex_digits[(uint8_t)s[0]];
+	uint8_t lo = hex_digits[(uint8_t)s[1]];
+	return ((hi | lo) & 0xF0) ? -1 : ((hi << 4) | lo);
+}
+
+/**
+	Decode a big endian value of up to 4 bytes.
+	@param s Source digits, 2 per byte.
+	@param bytes Number of bytes to decode, 1 - 4.
+	@param value Destination for the value.
+	@return On success, returns E_NONE.
+	@return If a digit is invalid, returns E_INVALID.
+*/
+int hex_field(const char *s, int bytes, uint32_t *value);
+
+/**
+	Decode a run of hexadecimal digits into bytes.
+	@param dst Destination for size bytes.
+	@param src Source digits, 2 per byte. Need not be NUL terminated.
+	@param size Number of bytes to decode.
+	@param psum Optional. The decoded bytes are summed into *psum, modulo 256, in the same pass.
+	@return On success, returns E_NONE.
+	@return If a digit is invalid, returns E_INVALID. dst[] is then partially written.
+*/
+int hex_decode(uint8_t *dst, const char *src, size_t size, uint8_t *psum);
+
+/**
+	Encode bytes as uppercase hexadecimal digits, two per byte.
+	@param dst Destination for 2 * size characters. Not NUL terminated.
+	@param src The bytes.
+	@param size Number of bytes in src[].
+*/
+void hex_encode(char *dst, const uint8_t *src, size_t size);
+
+#endif //__HEX_H__
+/** @} */
@@ -0,0 +1,62 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Intel HEX loader.
+Reads Intel HEX straight into a sparse @link image @endlink, the same one S-Records load into,
+so toolchain output no longer has to be converted to S-Records first.
+
+Supported record types:
+	- 00 - Data.
+	- 01 - End of file. Anything after it is ignored.
+	- 02 - Extended segment address, bits 4 - 19 of following addresses.
+	- 03 - Start segment address. Ignored.
+	- 04 - Extended linear address, bits 16 - 31 of following addresses.
+	- 05 - Start linear address. Ignored.
+
+@defgroup ihex Intel HEX
+@{
+*/
+#ifndef __IHEX_H__
+#define __IHEX_H__
+
+/** Enumeration of Intel HEX record types. */
+enum ihex_type {
+	IHEX_DATA			= 0x00,	/**< Data. */
+	IHEX_EOF			= 0x01,	/**< End of file. */
+	IHEX_SEGMENT		= 0x02,	/**< Extended segment address. */
+	IHEX_STARTSEGMENT	= 0x03,	/**< Start segment address. */
+	IHEX_LINEAR			= 0x04,	/**< Extended linear address. */
+	IHEX_STARTLINEAR	= 0x05,	/**< Start linear address. */
+};
+
+/**
+	Load an Intel HEX file into an image covering an address range.
+	@param image The dereferenced pointer is assigned to the new, sealed image.
+	@param path Path to the file, "-" for standard input.
+	@param address_low First address of the flash.
+	@param address_high Last address of the flash, inclusive.
+	@return On success, returns E_NONE.
+	@return If data falls outside the range, returns E_RANGE.
+	@return If data conflicts with earlier data, returns E_MISMATCH.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int ihex_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high);
+
+#endif //__IHEX_H__
+/** @} */
@@ -0,0 +1,218 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Sparse flash image.
+Only the 512 byte blocks that receive data are allocated, everything else reads as erased flash (0xFF).
+Memory and the cost of walking an image follow the size of the firmware, not the address space.
+Once loaded, image_seal() records which blocks hold data and their CRCs so the
+write, compare and verify paths only do table lookups.
+A sealed image can be saved with image_save() and mapped back in with image_load(),
+which skips parsing and CRC computation altogether.
+@defgroup image Flash Image
+@{
+*/
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+/** Size of an image block, the same as a kernal32 flash write. */
+#define IMAGE_BLOCK 512
+
+/** First bytes of a compiled image file. */
+#define IMAGE_MAGIC "KUJI32IM"
+
+/** Version of the compiled image file layout. */
+#define IMAGE_VERSION 1
+
+/**
+	Header of a compiled image file.
+	It is followed by the non-empty bitmap, the CRC table and then the payload of
+	every non-empty block in address order, each section starting 8 byte aligned.
+	All values are little endian, the layout of struct image in memory.
+*/
+struct image_header {
+	char magic[8];					/**< IMAGE_MAGIC, not terminated. */
+	uint32_t version;				/**< IMAGE_VERSION. */
+	uint32_t headersize;			/**< sizeof(struct image_header). */
+	char mcu[32];					/**< Name of the MCU the image was compiled for. */
+	uint32_t base;					/**< Address of the first block. */
+	uint32_t nblocks;				/**< Number of blocks in the range. */
+	uint32_t nfull;					/**< Number of payloads that follow. */
+	uint32_t reserved;				/**< Zero. */
+	uint8_t hash[SHA256_SIZE];		/**< image_hash() of the image. */
+};
+
+/** Sparse flash image. */
+struct image {
+	uint32_t base;			/**< Address of the first block. */
+	uint32_t end;			/**< One past the address of the last block. */
+	uint32_t nblocks;		/**< Number of entries in blocks[]. */
+	uint32_t nused;			/**< Number of allocated blocks. */
+	uint8_t **blocks;		/**< Page table, NULL for blocks that have not been written. */
+	uint64_t **covered;		/**< One bit per byte of every allocated block, set once the byte is written. */
+	uint32_t noverlap;		/**< Number of bytes written more than once with the same value. */
+	uint32_t nfull;			/**< Number of blocks that hold data i.e. not all 0xFF. Valid when sealed. */
+	uint32_t *nonempty;		/**< Bitmap of blocks that hold data. Valid when sealed. */
+	uint16_t *crcs;			/**< crcitt() of every block, erased ones included. Valid when sealed. */
+	uint16_t blankcrc;		/**< crcitt() of an erased block. */
+	bool sealed;			/**< Set by image_seal(), cleared by image_write(). */
+	bool hashed;			/**< Set once hash[] is valid. */
+	uint8_t hash[SHA256_SIZE];	/**< image_hash() of the image. */
+	const uint8_t *map;		/**< Mapped file of a loaded image, blocks and tables point into it. */
+	size_t maplen;			/**< Size of map[]. */
+};
+
+/**
+	Allocate an empty image covering an address range.
+	@param image The dereferenced pointer is assigned to the new image.
+	@param address_low First address of the range. Rounded down to a block.
+	@param address_high Last address of the range, inclusive.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int image_new(struct image **image, uint32_t address_low, uint32_t address_high);
+
+/**
+	Free an image and all its blocks.
+	@param image The dereferenced pointer is freed and assigned NULL.
+*/
+void image_free(struct image **image);
+
+/**
+	Copy data into the image, allocating blocks as needed.
+	Writing a byte again with the same value is counted in noverlap, with another value it is an error.
+	@param image The image.
+	@param address Address of data[0].
+	@param data The data.
+	@param size Number of bytes in data[].
+	@return On success, returns E_NONE.
+	@return If the image was loaded with image_load(), returns E_ACCESS.
+	@return If the data does not fit the image, returns E_RANGE.
+	@return If the data conflicts with earlier writes, returns E_MISMATCH.
+*/
+int image_write(struct image *image, uint32_t address, const uint8_t *data, uint32_t size);
+
+/**
+	Compute the non-empty bitmap and block CRCs.
+	Must be called after the last image_write() and before any of the lookups below.
+	srec_readimage() does this for you.
+	@param image The image.
+*/
+void image_seal(struct image *image);
+
+/**
+	Get the block that holds an address.
+	@param image The image.
+	@param address Any address within the block.
+	@return Returns IMAGE_BLOCK bytes of the block or NULL if nothing was written there.
+*/
+const uint8_t *image_block(struct image *image, uint32_t address);
+
+/**
+	Test if a block would leave flash erased.
+	@param image The image.
+	@param address Any address within the block.
+	@return If the block is missing or all 0xFF, returns true.
+*/
+bool image_isempty(struct image *image, uint32_t address);
+
+/**
+	Get the CRC of a block as the kernal computes it.
+	@param image The image.
+	@param address Any address within the block.
+	@return Returns crcitt() of the block, the CRC of an erased block if it holds no data.
+*/
+uint16_t image_crc(struct image *image, uint32_t address);
+
+/**
+	Find the next block that holds data.
+	Walk an image with: for (a = image_next(img, img->base); a < img->end; a = image_next(img, a + IMAGE_BLOCK)).
+	@param image The image.
+	@param address Start looking at the block holding this address.
+	@return Returns the address of the block or image->end if there are no more.
+*/
+uint32_t image_next(struct image *image, uint32_t address);
+
+/**
+	Load a raw binary file that starts at a given address.
+	The whole file is taken as is, 0xFF bytes included, and sealed.
+	@param image The dereferenced pointer is assigned to the new image.
+	@param path Path to the file, "-" for standard input.
+	@param address Flash address of the first byte of the file.
+	@param address_low First address of the flash.
+	@param address_high Last address of the flash, inclusive.
+	@return On success, returns E_NONE.
+	@return If the file does not fit the flash, returns E_RANGE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int image_readbinary(struct image **image, const char *path, uint32_t address, uint32_t address_low, uint32_t address_high);
+
+/**
+	Get the SHA-256 of the image contents.
+	The hash covers the address and data of every non-empty block, so it does not
+	depend on the input format or on how the records were laid out.
+	@param image The image.
+	@param digest Destination for SHA256_SIZE bytes.
+*/
+void image_hash(struct image *image, uint8_t *digest);
+
+/**
+	Save a sealed image as a compiled image file.
+	@param image The image.
+	@param path Path of the file to create.
+	@param mcu Name of the MCU the image is meant for.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int image_save(struct image *image, const char *path, const char *mcu);
+
+/**
+	Write a sealed image as a compiled image file to an open stream.
+	@param image The image.
+	@param F Stream opened for binary writing. It is left open.
+	@param mcu Name of the MCU the image is meant for.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int image_savestream(struct image *image, FILE *F, const char *mcu);
+
+/**
+	Test if data starts with IMAGE_MAGIC.
+	@param data At least as many bytes as struct image_header magic[].
+	@return If it is a compiled image, returns true.
+*/
+static inline bool image_probe(const uint8_t *data) {
+	return memcmp(data, IMAGE_MAGIC, sizeof(((struct image_header *)0)->magic)) == 0;
+}
+
+/**
+	Map a compiled image file.
+	Blocks, bitmap and CRCs are used in place, nothing is parsed or computed.
+	The image is sealed and read only.
+	@param image The dereferenced pointer is assigned to the new image.
+	@param path Path to the file.
+	@param mcu Optional destination for the MCU name, 32 bytes.
+	@return On success, returns E_NONE.
+	@return If the file is not a compiled image of this version, returns E_TYPE.
+	@return If the file is truncated or inconsistent, returns E_MSGMALFORMED.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+int image_load(struct image **image, const char *path, char *mcu);
+
+#endif //__IMAGE_H__
+/** @} */
@@ -0,0 +1,108 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+On-disk progress journal for resumable programming.
+The journal is a small text file that names the MCU and the image hash and then lists, one per line,
+every flash block the kernal has acknowledged. After a power or cable failure a new run can confirm
+the listed blocks against the device and only write what is left, without erasing.
+
+Example:
+@verbatim
+KUJI32JOURNAL 1
+mcu MB91F362
+image 5f1c...e0
+block 0x0C0000
+block 0x0C0200
+@endverbatim
+
+@defgroup journal Progress Journal
+@{
+*/
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+/** Progress journal state. */
+struct journal {
+	char path[MAX_PATH];			/**< Path to the journal file. */
+	FILE *F;						/**< Journal file, open for appending while programming. */
+	char mcu[64];					/**< Name of the MCU the journal is for. */
+	uint8_t hash[SHA256_SIZE];		/**< Hash of the image the journal is for. */
+	uint32_t base;					/**< Address of the first block. */
+	uint32_t nblocks;				/**< Number of blocks in done[]. */
+	uint8_t *done;					/**< One entry per block, non-zero once acknowledged. */
+	uint32_t ndone;					/**< Number of non-zero entries in done[]. */
+	bool resumable;					/**< The journal on disk belongs to this MCU and image. */
+};
+
+/**
+	Allocate for a journal and load the journal file if there is one.
+	If the file belongs to the same MCU and image then resumable is set.
+	@param j The dereferenced pointer is assigned to the newly allocated journal.
+	@param path Path to the journal file.
+	@param mcu Name of the MCU.
+	@param hash Hash of the image.
+	@param base Address of the first block.
+	@param size Number of bytes covered by the journal.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int journal_new(struct journal **j, const char *path, const char *mcu, const uint8_t *hash, uint32_t base, uint32_t size);
+
+/**
+	Close the journal file and free the journal.
+	@param j The dereferenced pointer is freed and assigned NULL.
+*/
+void journal_free(struct journal **j);
+
+/**
+	Open the journal file for recording.
+	@param j The journal.
+	@param resume If true, keep the blocks already recorded, otherwise start over.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int journal_begin(struct journal *j, bool resume);
+
+/**
+	Record an acknowledged block and flush it to disk.
+	@param j The journal.
+	@param address Address of the block.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int journal_mark(struct journal *j, uint32_t address);
+
+/**
+	Test if a block has been recorded.
+	@param j The journal.
+	@param address Address of the block.
+	@return Returns true if the block was acknowledged.
+*/
+bool journal_isdone(struct journal *j, uint32_t address);
+
+/**
+	Remove the journal file once programming has completed.
+	@param j The journal.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int journal_finish(struct journal *j);
+
+#endif //__JOURNAL_H__
+/** @} */
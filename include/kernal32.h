@@ -70,6 +70,74 @@ struct kernal32 {
 	struct chipdef32 *chip;		/**< Current chip configuration. */
 };
 
+/** Enumeration of the phases a non-blocking kernal32 operation goes through. */
+enum kernal32_phase {
+	KERNAL32_PHASE_IDLE = 0,	/**< No operation has been started. */
+	KERNAL32_PHASE_COMMAND,		/**< Command bytes are waiting to be sent. */
+	KERNAL32_PHASE_PREAMBLE,	/**< Waiting for busy, ready or acknowledge markers. */
+	KERNAL32_PHASE_PAYLOAD,		/**< Sending or receiving the data block. */
+	KERNAL32_PHASE_TRAILER,		/**< Sending or receiving checksum and final confirmation. */
+	KERNAL32_PHASE_DONE,		/**< Operation has finished, see result. */
+};
+
+/**
+Non-blocking kernal32 state machine.
+The machine never touches a serial port. The caller sends tx[0..txlen-1], feeds whatever
+it receives into kernal32_step() and calls it again no later than at deadline.
+This way a single thread can drive any number of MCUs.
+*/
+struct kernal32_machine {
+	enum kernal32_cmdid cmd;	/**< Command in progress. */
+	enum kernal32_phase phase;	/**< Where we are in the command. */
+	uint32_t address;			/**< Flash address of the command. */
+	uint8_t *buf;				/**< Data block to send or receive. */
+	uint32_t size;				/**< Number of bytes in buf[]. */
+	uint32_t pos;				/**< Number of payload bytes received so far. */
+	uint8_t cmdbuf[8];			/**< Storage for outgoing command and checksum bytes. */
+	uint8_t rx[12];				/**< Storage for incoming markers and trailers. */
+	int rxlen;					/**< Number of bytes in rx[]. */
+	uint8_t *tx;				/**< Next bytes the caller must send. */
+	int txlen;					/**< Number of bytes remaining in tx[]. */
+	double deadline;			/**< Call kernal32_step() at this get_ticks() time at the latest. */
+	double timeout;				/**< The operation fails with E_TIMEOUT at this get_ticks() time. */
+	uint16_t crc;				/**< CRC of the last block sent or received. */
+	uint16_t rxcrc;				/**< crcitt() of the payload received so far. */
+	int result;					/**< E_WOULDBLOCK while busy, then the final result. */
+};
+
+/**
+Start a non-blocking kernal32 operation.
+The caller should purge the serial port before starting a new command, just like the blocking functions do.
+@param m State machine. Must not be busy with another operation.
+@param cmd The command to run.
+@param flash_base Flash address for the command.
+@param buf Data block for KERNAL32_CMD_READFLASH and KERNAL32_CMD_WRITEFLASH, otherwise NULL.
+@param size Number of bytes in buf[].
+@param now Current time from get_ticks().
+@return On success, returns E_NONE.
+@return On failure, returns a negative error code.
+*/
+int kernal32_begin(struct kernal32_machine *m, enum kernal32_cmdid cmd, uint32_t flash_base, uint8_t *buf, uint32_t size, double now);
+
+/**
+Advance a non-blocking kernal32 operation.
+Call this whenever bytes are received, after bytes were sent and when the deadline passes.
+@param m State machine.
+@param rx Received bytes, can be NULL.
+@param rxlen Number of bytes in rx[].
+@param now Current time from get_ticks().
+@return While the operation is in progress, returns E_WOULDBLOCK.
+@return When done, returns what the blocking counterpart would have returned e.g. 1 for a blank chip from blank check.
+*/
+int kernal32_step(struct kernal32_machine *m, const uint8_t *rx, int rxlen, double now);
+
+/**
+Tell the machine that the caller has sent some of the pending tx[] bytes.
+@param m State machine.
+@param n Number of bytes sent.
+*/
+void kernal32_sent(struct kernal32_machine *m, int n);
+
 /**
 Allocate for a new kernal32 state.
 Opens up serial communication to com port.
@@ -128,16 +196,45 @@ This can take a while to finish.
 */
 int kernal32_writeflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf, uint32_t size, uint16_t *pcsum);
 
+/**
+Write 512 bytes of data to flash with a precomputed checksum.
+Use this when the CRC is already known, e.g. from image_crc().
+@param state Kernal32 state.
+@param flash_base Base address of flash sector.
+@param buf Byte buffer to write.
+@param size Number of bytes in buf[].
+@param crc crcitt() of buf[], truncated to 16 bits.
+@return On success, returns E_NONE.
+@return On failure, returns a negative error code.
+*/
+int kernal32_writeflashcrc(struct kernal32 *state, uint32_t flash_base, uint8_t *buf, uint32_t size, uint16_t crc);
+
+/**
+Check that loaded S-Records can be written with kernal32_writeflashsrec().
+@param chip MCU descriptor.
+@param reclist List of S-Records.
+@param flash_base Base address of flash sector.
+@return If the records can be written as they are, returns E_NONE.
+@return If a record is out of flash, returns E_RANGE.
+@return If a record goes back to an earlier sector, returns E_ORDER. The records are fine, just not for streaming.
+*/
+int kernal32_checksrec(struct chipdef32 *chip, struct srec_list *reclist, uint32_t flash_base);
+
 /**
 Write loaded S-Record to MCU flash.
 This buffers up S-Record data into 512 byte writes.
+Blocks are aligned to flash_base and gaps are padded with 0xFF. Only S1, S2 and S3 records are written.
+Blocks that end up all 0xFF are left out, the flash is erased already.
+Records must be in ascending sector order. The list is checked before anything is written.
 @param state Kernal32 state.
 @param reclist List of S-Records to write.
 @param flash_base Base address of flash sector.
 @return On success, returns E_NONE.
+@return If a record is out of flash, returns E_RANGE.
+@return If a record goes back to an earlier sector, returns E_ORDER.
 @return On failure, returns a negative error code.
 */
-int kernal32_writeflashsrec(struct kernal32 *state, struct srec *reclist, uint32_t flash_base);
+int kernal32_writeflashsrec(struct kernal32 *state, struct srec_list *reclist, uint32_t flash_base);
 
 /**
 Read 512 bytes of data from flash into buf.
@@ -151,6 +248,19 @@ Read 512 bytes of data from flash into buf.
 */
 int kernal32_readflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf, uint32_t size, uint16_t *pcrc);
 
+/**
+Verify a flash block by reading it back and comparing only the CRC.
+@param state Kernal32 state.
+@param flash_base Base address of flash sector.
+@param size Number of bytes in the block. At most 512 bytes.
+@param crc Expected crcitt() of the block.
+@param pcrc Optional destination for the CRC of the block in flash.
+@return On success i.e. the block matches, returns E_NONE.
+@return If the block does not match, returns E_MISMATCH.
+@return On failure, returns a negative error code.
+*/
+int kernal32_verifyflash(struct kernal32 *state, uint32_t flash_base, uint32_t size, uint16_t crc, uint16_t *pcrc);
+
 #endif //__KERNAL32_H__
 
 /** @} */
@@ -0,0 +1,159 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Block CRC manifests.
+A manifest describes a flash image without its payload: the range, the CRC of every block
+and the image_hash() of the whole image. It is a small text file kept next to the file it
+describes, named by adding MANIFEST_SUFFIX. Dumps made with '-r' always get one.
+
+With manifests two files, or a file and a device, can be compared block by block without
+parsing either file again. A manifest is only used while the fileidentity() of its file,
+device, inode, size, modification and change time, is the one it recorded. A raw binary
+file also records the address given to '--base'.
+
+Only blocks that hold data are listed, every other block is erased flash.
+
+Example:
+@verbatim
+KUJI32MANIFEST 2
+mcu MB91F362
+base 0x080000
+blocks 1024
+source 2049 1835017 16384 1713370000000000000 1713370000000000000
+image 5f1c...e0
+crc 0x080000 1A2B
+crc 0x080200 3C4D
+@endverbatim
+
+@defgroup manifest Block CRC Manifest
+@{
+*/
+#ifndef __MANIFEST_H__
+#define __MANIFEST_H__
+
+/** Added to the name of a file to name its manifest. */
+#define MANIFEST_SUFFIX ".manifest"
+
+/** Block CRC manifest. */
+struct manifest {
+	char mcu[32];				/**< Name of the MCU. */
+	uint32_t base;				/**< Address of the first block. */
+	uint32_t end;				/**< One past the address of the last block. */
+	uint32_t nblocks;			/**< Number of blocks in the range. */
+	uint32_t nfull;				/**< Number of blocks that hold data. */
+	uint32_t *nonempty;			/**< Bitmap of blocks that hold data. */
+	uint16_t *crcs;				/**< crcitt() of every block, erased ones included. */
+	uint16_t blankcrc;			/**< crcitt() of an erased block. */
+	uint8_t hash[SHA256_SIZE];	/**< image_hash() of the image. Valid once finished. */
+	uint32_t next;				/**< Lowest address manifest_add() accepts. */
+	struct sha256 ctx;			/**< Running image hash while blocks are added. */
+	bool finished;				/**< Set by manifest_finish(). */
+	bool raw;					/**< The file is raw binary placed at rawbase. */
+	uint32_t rawbase;			/**< Address given to '--base' for raw binary. */
+};
+
+/**
+	Allocate an empty manifest covering an address range, every block erased.
+	@param m The dereferenced pointer is assigned to the new manifest.
+	@param mcu Name of the MCU.
+	@param address_low First address of the range. Rounded down to a block.
+	@param address_high Last address of the range, inclusive.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *m assigned NULL.
+*/
+int manifest_new(struct manifest **m, const char *mcu, uint32_t address_low, uint32_t address_high);
+
+/**
+	Add a block. Blocks must be added in ascending order, erased ones may be left out.
+	@param m The manifest.
+	@param address Address of the block, a multiple of IMAGE_BLOCK.
+	@param block IMAGE_BLOCK bytes of data.
+	@return On success, returns E_NONE.
+	@return If the block is out of range or order, returns E_RANGE.
+*/
+int manifest_add(struct manifest *m, uint32_t address, const uint8_t *block);
+
+/**
+	Complete the image hash once all blocks are added.
+	@param m The manifest.
+*/
+void manifest_finish(struct manifest *m);
+
+/**
+	Make the manifest of a sealed image. Only the image tables are used.
+	@param m The dereferenced pointer is assigned to the new manifest.
+	@param image The image.
+	@param mcu Name of the MCU.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *m assigned NULL.
+*/
+int manifest_fromimage(struct manifest **m, struct image *image, const char *mcu);
+
+/**
+	Write the manifest of a file next to it.
+	A file changed in the last few seconds may still be changing, it gets no manifest unless the caller wrote it.
+	@param m The manifest, finished.
+	@param source Path to the file the manifest describes.
+	@param written The caller has just written and closed the file itself, so it is not changing.
+	@return On success, returns E_NONE.
+	@return If the file changed too recently, returns E_NOTREADY.
+	@return On failure, returns a negative error code.
+*/
+int manifest_save(struct manifest *m, const char *source, bool written);
+
+/**
+	Load the manifest next to a file.
+	@param m The dereferenced pointer is assigned to the manifest.
+	@param source Path to the file.
+	@param mcu Name of the MCU the manifest must be for.
+	@param address_low First address of the flash.
+	@param address_high Last address of the flash, inclusive.
+	@param raw The file is raw binary.
+	@param rawbase Address the raw binary is placed at.
+	@return On success, returns E_NONE.
+	@return If there is no manifest, returns E_NOTEXIST.
+	@return If the manifest is for another MCU, range, placement or version of the file, returns E_MISMATCH.
+	@return If the manifest is malformed, returns E_MSGMALFORMED.
+*/
+int manifest_load(struct manifest **m, const char *source, const char *mcu, uint32_t address_low, uint32_t address_high, bool raw, uint32_t rawbase);
+
+/**
+	Test if a block is erased.
+	@param m The manifest.
+	@param address Address of the block.
+	@return Returns true if the block holds no data or is out of range.
+*/
+bool manifest_isempty(struct manifest *m, uint32_t address);
+
+/**
+	Get the CRC of a block.
+	@param m The manifest.
+	@param address Address of the block.
+	@return Returns crcitt() of the block, the CRC of an erased block if it holds no data.
+*/
+uint16_t manifest_crc(struct manifest *m, uint32_t address);
+
+/**
+	Free a manifest.
+	@param m The dereferenced pointer is freed and assigned NULL.
+*/
+void manifest_free(struct manifest **m);
+
+#endif //__MANIFEST_H__
+/** @} */
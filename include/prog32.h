@@ -45,8 +45,18 @@ Both stage 1 and 2 use CRC16.
 -c \<freq\>    Select target crystal (megahertz) e.g 4, 8, 16 etc.
 -e           Erase MCU flash.
 -r           Read MCU flash and write it to stdout as S-Records.
--w \<file\>    Write S-Record file to MCU flash.
--v           Verify MCU flash after programming.
+-w \<file\>    Write S-Record, Intel HEX or 32 bit ELF file to MCU flash. The format is detected from the contents.
+--verify     Verify MCU flash by reading back each block right after programming it.
+--skip-identical  Compare MCU flash to the S-Record file first and skip erase and write if they match.
+--journal \<file\>  Record acknowledged blocks in a journal. A later run resumes from it without erasing.
+--compile-image \<file\>  Compile the file given to -w into an image for the MCU and exit. -w accepts the image.
+--cache \<dir\>  Keep parsed S-Record files in a cache directory so loading the same file again skips parsing.
+--base \<addr\>  The file given to -w is raw binary starting at this address.
+--srec-type \<1-3\>  Write S1, S2 or S3 records with -r. Default is S2.
+--srec-length \<n\>  Write up to n data bytes per record with -r, at most 250. Default is 16.
+--srec-end   End the file written with -r with an S5 record count and an S9, S8 or S7 termination record.
+--diff \<file\>  Compare the file with the one given to -w, or with MCU flash without -w. Reports changed blocks and an estimated programming time.
+--manifest   Write a block CRC manifest next to the file given to -w and exit. Dumps made with -r always get one.
 -p \<com\>     Set com port Id from 1-99.
 -p \<com\>     Set com port device e.g. '/dev/ttyS0'.
 </pre>
@@ -61,6 +71,18 @@ Erase MCU:
 Write S-Records to MCU:
 <pre>$./kuji32 -p1 -mmb91f362 -w firmware.mhx</pre>
 
+Compile S-Records once into an image that loads instantly:
+<pre>$./kuji32 -mmb91f362 -w firmware.mhx --compile-image firmware.k32
+$./kuji32 -p1 -mmb91f362 -e -w firmware.k32</pre>
+
+Compare two firmware files, or a firmware file with the chip:
+<pre>$./kuji32 -mmb91f362 -w old.mhx --diff new.mhx
+$./kuji32 -p1 -mmb91f362 --diff new.mhx</pre>
+
+Give a release a manifest, so comparing it or skipping an up to date chip needs no parsing:
+<pre>$./kuji32 -mmb91f362 -w firmware.mhx --manifest
+$./kuji32 -p1 -mmb91f362 --diff firmware.mhx</pre>
+
 Do it all in one step:
 <pre>$./kuji32 -p1 -mmb91f362 -r backupfirmware.mhx -e -w firmware.mhx</pre>
 
@@ -207,6 +229,7 @@ enum failures32 {
 	FAIL_INITKERNAL	= 12,	/**< Error initializing Kernal interface. */
 	FAIL_BLANK			= 13,	/**< Error blank-checking MCU. */
 	FAIL_ERASE			= 14,	/**< Error erasing MCU. */
+	FAIL_VERIFY			= 15,	/**< Flash contents did not match the image after programming. */
 };
 
 /** MCU nametag. */
@@ -289,12 +312,24 @@ struct params32 {
 	char *srecpath;		/**< Parameter given to '-w'. */
 	char *savepath;		/**< Parameter given to '-r'. */
 	char *comarg;		/**< Parameter given to '-p'. */
+	char *journalpath;	/**< Parameter given to '--journal'. */
+	char *compilepath;	/**< Parameter given to '--compile-image'. */
+	char *cachedir;		/**< Parameter given to '--cache'. */
+	char *diffpath;		/**< Parameter given to '--diff'. */
+	uint32_t base;		/**< Parameter given to '--base'. */
+	bool hasbase;		/**< '--base' was given, '-w' is raw binary. */
+	uint8_t srectype;	/**< Parameter given to '--srec-type', 0 for the default. */
+	uint8_t sreclength;	/**< Parameter given to '--srec-length', 0 for the default. */
+	bool srecend;		/**< '--srec-end' was given. */
 
 	bool erase;			/**< User requested erase with '-e'. */
 	bool read;			/**< User requested read with '-r'. */
 	bool write;			/**< User requested write with '-w'. */
 	bool blankcheck;	/**< User requested blank with '-b'. */
 	bool debugging;		/**< User requested debugging output with '-d'. */
+	bool verify;		/**< User requested read-back verification with '--verify'. */
+	bool skipidentical;	/**< User requested to leave an up to date chip alone with '--skip-identical'. */
+	bool manifest;		/**< User requested a manifest of the file given to '-w' with '--manifest'. */
 
 	int timeoutsec;		/**< Parameter given to '-t'. */
 	enum frequency freq;	/**< Currently selected target crystal frequency. */
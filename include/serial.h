@@ -27,6 +27,9 @@ Subsystem to access serial ports.
 #ifndef __SERIAL_H__
 #define __SERIAL_H__
 
+/** Bytes a tty driver queues for transmit, e.g. a page on Linux. A write of no more returns without waiting for the line. */
+#define SERIAL_TXCHUNK 4096
+
 /** Serial port state. */
 struct serial {
 	char address[255];	/**< Device path. */
@@ -0,0 +1,69 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+SHA-256 message digest.
+Used wherever an image must be identified by content e.g. progress journals.
+@defgroup sha256 SHA-256
+@{
+*/
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+/** Size in bytes of a SHA-256 digest. */
+#define SHA256_SIZE 32
+
+/** SHA-256 context. */
+struct sha256 {
+	uint32_t state[8];		/**< Intermediate hash value. */
+	uint64_t length;		/**< Total number of bytes hashed so far. */
+	uint8_t block[64];		/**< Partial input block. */
+	uint32_t used;			/**< Number of bytes in block[]. */
+};
+
+/**
+	Initialize a SHA-256 context.
+	@param ctx The context.
+*/
+void sha256_init(struct sha256 *ctx);
+
+/**
+	Hash more data.
+	@param ctx The context.
+	@param data Data to hash.
+	@param size Number of bytes in data[].
+*/
+void sha256_update(struct sha256 *ctx, const void *data, size_t size);
+
+/**
+	Finish hashing and produce the digest.
+	@param ctx The context. Must be initialized again before reuse.
+	@param digest Destination for SHA256_SIZE bytes of digest.
+*/
+void sha256_final(struct sha256 *ctx, uint8_t *digest);
+
+/**
+	Format a digest as lowercase hexadecimal.
+	@param digest SHA256_SIZE bytes of digest.
+	@param hex Destination for 2 * SHA256_SIZE characters and a terminating zero.
+	@return Returns hex.
+*/
+char *sha256_hex(const uint8_t *digest, char *hex);
+
+#endif //__SHA256_H__
+/** @} */
@@ -33,17 +33,62 @@ struct srec {
 	uint32_t address;	/**< Address associated with data. */
 	uint8_t csum;		/**< Check sum of data. */
 	struct srec *next;	/**< For linked listing. */
-	uint8_t data[0xFF];	/**< Payload data. */
+	uint8_t data[0xFF];	/**< Payload data. Records in a struct srec_list only have room for count bytes. */
 };
 
+/** Size of the chunks a struct srec_list allocates its records from. */
+#define SREC_ARENA_CHUNK (1024 * 1024)
+
+/** One chunk of record storage. */
+struct srec_arena {
+	struct srec_arena *next;	/**< Next chunk. */
+	size_t used;				/**< Number of bytes handed out from mem[]. */
+	size_t size;				/**< Number of bytes in mem[]. */
+	uint8_t mem[];				/**< The records, back to back. */
+};
+
+/**
+	List of S-Records in file order.
+	Records are bump allocated back to back from a few large chunks, each taking only
+	as much room as its data, so memory follows the payload and the list is freed at once.
+	Walk it with: for (sr = list->head; sr; sr = sr->next).
+*/
+struct srec_list {
+	struct srec *head;			/**< First record. */
+	struct srec *tail;			/**< Last record. */
+	struct srec_arena *arena;	/**< Chunk records are allocated from, older chunks follow. */
+	uint32_t count;				/**< Number of records. */
+};
+
+/**
+	Callback for srec_scanfile().
+	@param rec A valid record. Only valid for the duration of the call.
+	@param ctx User context given to srec_scanfile().
+	@return To continue scanning, returns E_NONE.
+	@return To stop scanning, returns a negative error code which srec_scanfile() then returns.
+*/
+typedef int (*srec_visitor)(struct srec *rec, void *ctx);
+
+/**
+	Scan all records in a file without copying lines.
+	Regular files are memory mapped, pipes and standard input ("-") are streamed.
+	Blank lines are skipped, any malformed line or checksum mismatch stops the scan.
+	@param path Path to the S-Record file or "-" for standard input.
+	@param visit Called for every record in file order.
+	@param ctx Passed to visit.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int srec_scanfile(const char *path, srec_visitor visit, void *ctx);
+
 /**
-	Read contents of filepath into a linked list and returns the head.
+	Read contents of filepath into a record list.
 	@param reclist The dereferenced pointer is assigned to the newly allocated list.
 	@param filepath Path to the S-Record file.
-	@return On success, returns E_NONE with *reclist assigned to the new head.
+	@return On success, returns E_NONE with *reclist assigned to the new list.
 	@return On failure, returns a negative error code with *reclist assigned NULL.
 */
-int srec_readfile(struct srec **reclist, const char *filepath);
+int srec_readfile(struct srec_list **reclist, const char *filepath);
 
 /**
 	Print S-Record list to stdout.
@@ -51,50 +96,166 @@ int srec_readfile(struct srec **reclist, const char *filepath);
 	@return On success, returns E_NONE.
 	@return On failure, returns a negative error code.
 */
-int srec_printlist(struct srec *reclist);
+int srec_printlist(struct srec_list *reclist);
 
 /**
-	Free all entries in the given S-Record list.
+	Free the given S-Record list and all its records.
 	@param reclist The dereferenced pointer is assigned NULL after freeing all its entries.
 */
-void srec_freelist(struct srec **reclist);
+void srec_freelist(struct srec_list **reclist);
+
+/**
+	Read S-Records from file into a sparse image.
+	S1, S2 and S3 data records are accepted, other types are ignored.
+	@param image The dereferenced pointer is assigned to the new image covering address_low to address_high.
+	@param path Path to the S-Record file (*.mhx) or "-" for standard input.
+	@param address_low Lower bound for address check.
+	@param address_high Upper bound for address check.
+	@return On success, returns E_NONE with *image assigned to the new image.
+	@return On failure, returns a negative error code with *image assigned to NULL.
+*/
+int srec_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high);
 
 /**
-	Read S-Records from file and write them to a linear buffer.
-	The buffer is allocated as 16 megabytes so 24 bit address from S-Record works directly.
-	This also means that only S2 data records are accepted, other types are ignored.
-	@param buf The dereferenced pointer is assigned to the newly allocated buffer and is filled with record data.
-	@param path Path to the S-Record file (*.mhx).
+	Place already loaded S-Records into a sparse image, as srec_readimage() does for a file.
+	Use this when the file can not be read again, e.g. standard input.
+	@param image The dereferenced pointer is assigned to the new image covering address_low to address_high.
+	@param reclist The S-Records.
+	@param path Name of the source for error messages.
 	@param address_low Lower bound for address check.
 	@param address_high Upper bound for address check.
-	@return On success, returns E_NONE with *buf assigned to the new buffer.
-	@return On failure, returns a negative error code with *buf assigned to NULL.
+	@return On success, returns E_NONE with *image assigned to the new image.
+	@return On failure, returns a negative error code with *image assigned to NULL.
+*/
+int srec_listimage(struct image **image, struct srec_list *reclist, const char *path, uint32_t address_low, uint32_t address_high);
+
+/** Largest block a writer queues at a time, the size of a kernal32 flash read. */
+#define SREC_WRITER_BLOCK 512
+
+/** Size of the stdio buffer of files written as S-Records. */
+#define SREC_WRITER_BUFFER (1024 * 1024)
+
+/** Number of blocks a writer queues before srec_writer_put() waits for the encoder. */
+#define SREC_WRITER_SLOTS 8
+
+/** Most data bytes in one record, an S3 record with a count of 255. */
+#define SREC_LENGTH_MAX 250
+
+/** Data bytes per record unless told otherwise. */
+#define SREC_LENGTH_DEFAULT 16
+
+/** How S-Records are written. */
+struct srec_format {
+	uint8_t rectype;	/**< Type of data records (1, 2 or 3). */
+	uint8_t length;		/**< Most data bytes per record, 1 - SREC_LENGTH_MAX. */
+	bool terminate;		/**< End with a record count (S5 or S6) and a termination record (S9, S8 or S7). */
+};
+
+/**
+	Check an output format.
+	@param format The format.
+	@param address_high Highest address that will be written.
+	@return If the format is usable, returns E_NONE.
+	@return If the record type can not express address_high, returns E_RANGE.
+	@return Otherwise, returns E_ARGUMENT.
+*/
+int srec_checkformat(const struct srec_format *format, uint32_t address_high);
+
+/** One queued block of a writer. */
+struct srec_writerslot {
+	uint32_t address;					/**< Address of data[0]. */
+	uint32_t size;						/**< Number of bytes in data[]. */
+	uint8_t data[SREC_WRITER_BLOCK];	/**< The data. */
+};
+
+/**
+	Streaming S-Record writer.
+	Blocks are encoded and written as they are put, on a thread of their own where available,
+	so a full chip never needs to be held in memory. Records run across block boundaries.
+*/
+struct srec_writer {
+	FILE *F;				/**< Destination file. */
+	char path[MAX_PATH];	/**< Path to the file, for messages. */
+	struct srec_format format;	/**< Output format. */
+	int rc;					/**< First error, E_NONE if all is well. */
+	uint32_t nrecords;		/**< Number of data records written. */
+	uint32_t stageaddr;		/**< Address of stage[0]. */
+	uint32_t staged;		/**< Number of bytes in stage[] not yet in a record. */
+	uint8_t stage[SREC_WRITER_BLOCK + SREC_LENGTH_MAX];	/**< Data that may still join the next block's records. */
+#ifndef __WIN32__
+	bool threaded;			/**< The encoder thread is running. */
+	bool closing;			/**< No more blocks will be put. */
+	pthread_t thread;		/**< Encoder thread. */
+	pthread_mutex_t lock;	/**< Guards head, tail, closing and rc. */
+	pthread_cond_t ready;	/**< Signalled when a block is queued or the writer closes. */
+	pthread_cond_t space;	/**< Signalled when a slot is free again. */
+	uint32_t head;			/**< Number of blocks queued so far. */
+	uint32_t tail;			/**< Number of blocks written so far. */
+	struct srec_writerslot slots[SREC_WRITER_SLOTS];	/**< Ring of queued blocks. */
+#endif
+};
+
+/**
+	Create an S-Record file and start its writer.
+	@param w The dereferenced pointer is assigned to the new writer.
+	@param path Path to the file that receives the S-Records.
+	@param format Output format, see srec_checkformat().
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *w assigned NULL.
+*/
+int srec_writer_new(struct srec_writer **w, const char *path, const struct srec_format *format);
+
+/**
+	Queue data for writing. Runs of 0xFF are left out as by srec_printbuffer().
+	Waits only if the encoder is SREC_WRITER_SLOTS blocks behind.
+	@param w The writer.
+	@param address Address of buf[0].
+	@param buf The data. Copied, the caller may reuse it on return.
+	@param size Number of bytes in buf[].
+	@return On success, returns E_NONE.
+	@return If an earlier write failed, returns a negative error code.
+*/
+int srec_writer_put(struct srec_writer *w, uint32_t address, const uint8_t *buf, size_t size);
+
+/**
+	Write out everything queued, the termination records if asked for, and close the file.
+	@param w The writer.
+	@return If everything was written, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+int srec_writer_finish(struct srec_writer *w);
+
+/**
+	Finish the writer if that was not done and free it.
+	@param w The dereferenced pointer is freed and assigned NULL.
 */
-int srec_readfilebin(uint8_t **buf, const char *path, uint32_t address_low, uint32_t address_high);
+void srec_writer_free(struct srec_writer **w);
 
 /**
 	Write binary buffer to file as S-Records.
 	@param buf The binary buffer.
 	@param size How many bytes in buffer[].
 	@param path Path to file that receives the S-Records.
-	@param rectype Type of data records (1, 2 or 3).
+	@param format Output format, see srec_checkformat().
 	@param address The base address of the buffer.
 	@return On success, returns E_NONE.
 	@return On failure, returns a negative error code.
 */
-int srec_writefilebin(uint8_t *buf, size_t size, const char *path, uint8_t rectype, uint32_t address);
+int srec_writefilebin(uint8_t *buf, size_t size, const char *path, const struct srec_format *format, uint32_t address);
 
 /**
-	Print binary buffer to stdout as S-Records.
+	Print binary buffer as S-Records.
+	A record starts at the first byte that is not 0xFF and ends before a run of 0xFF
+	that costs more to write out than starting a new record.
 	@param buf The binary buffer.
 	@param size How many bytes in buffer[].
-	@param rectype Type of data records (1, 2 or 3).
+	@param format Output format, see srec_checkformat().
 	@param address The base address of the buffer.
 	@param F Optional file pointer. If NULL then output goes to stdout.
 	@return On success, returns E_NONE.
 	@return On failure, returns a negative error code.
 */
-int srec_printbuffer(uint8_t *buf, size_t size, uint8_t rectype, uint32_t address, FILE *F);
+int srec_printbuffer(uint8_t *buf, size_t size, const struct srec_format *format, uint32_t address, FILE *F);
 
 #endif //__SREC_H__
 /** @} */
@@ -68,6 +68,12 @@ or project specific include files that are used frequently, but are changed infr
 
 #ifndef __WIN32__
 #include <termios.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
 #endif
 
 //Local includes.
@@ -76,7 +82,17 @@ or project specific include files that are used frequently, but are changed infr
 #include "log.h"
 #include "util.h"
 #include "serial.h"
+#include "sha256.h"
+#include "hex.h"
+#include "blank.h"
+#include "image.h"
+#include "manifest.h"
+#include "diff.h"
 #include "srec.h"
+#include "ihex.h"
+#include "elf32.h"
+#include "cache.h"
+#include "journal.h"
 #include "prog32.h"
 #include "birom32.h"
 #include "kernal32.h"
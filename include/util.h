@@ -130,6 +130,44 @@ Taken from his website: http://sws.dett.de
 */
 int hex_dump(FILE *F, void *data, int size);
 
+#ifdef __WIN32__
+/** Windows builds run on one thread, a flag will do. */
+typedef bool once_t;
+/** Initial value of a once_t. */
+#define ONCE_INIT false
+#else
+/** Guard for run_once(). */
+typedef pthread_once_t once_t;
+/** Initial value of a once_t. */
+#define ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+/**
+Run an initializer exactly once, even when threads race to be first.
+Lazily probed CPU levels and tables are set up through this, the parser and writer threads use them too.
+@param once Guard, initialized to ONCE_INIT.
+@param init The initializer.
+*/
+void run_once(once_t *once, void (*init)(void));
+
+/** Vector paths are built only where the compiler can target them per function. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86
+#endif
+
+/** Widest vector instructions this CPU has, as far as the vector paths care. */
+enum cpu_level {
+	CPU_LEVEL_SCALAR = 0,	/**< No usable vector instructions. */
+	CPU_LEVEL_SSE2,			/**< 16 byte vectors. */
+	CPU_LEVEL_AVX2,			/**< 32 byte vectors. */
+};
+
+/**
+Tell which vector paths this CPU can run. Probed once, safe to call from any thread.
+@return Returns the best level.
+*/
+enum cpu_level cpu_level(void);
+
 /**
 Returns the a point in time relative to a set point in the past such as system boot up or UNIX epoch.
 The resolution varies between systems. In Windows this is milliseconds i.e. GetTickCount() and
@@ -328,20 +366,36 @@ uint8_t checksum8(uint8_t *buf, int len);
 
 /**
 Simple 16 bit checksum. Returns accumulated bytes values.
+Sums of pieces add up to the sum of the whole, so a buffer can be summed as it is sent.
+Uses SSE2 or AVX2 where the CPU has them.
 @param buf The buffer to accumulate.
 @param len Total number of bytes in buf[].
 @return Returns the 16 bit sum.
 */
 uint16_t checksum16(uint8_t *buf, int len);
 
+/** Polynomial of crcitt(), x^16 + x^12 + x^5 + 1. */
+#define CRCITT_POLY 0x1021
+
 /**
 	Calculate CRC16 value from buf[0] to buf[len-1].
+	CRC-CCITT with polynomial CRCITT_POLY, initial value 0, no reflection and no final XOR.
 	@param buf Data to checksum.
 	@param len Number of bytes in buf[].
-	@return Returns the checksum value.
+	@return Returns the checksum value, 0 - 0xFFFF.
 */
 unsigned int crcitt(uint8_t *buf, int len);
 
+/**
+	Continue a crcitt() over more data, so data can be checksummed in pieces.
+	crcitt_feed(crcitt_feed(0, a, n), b, m) equals crcitt() over a[] followed by b[].
+	@param crc CRC of the data so far, 0 to start.
+	@param buf More data.
+	@param len Number of bytes in buf[].
+	@return Returns the CRC including buf[].
+*/
+uint16_t crcitt_feed(uint16_t crc, const uint8_t *buf, size_t len);
+
 /**
 Allocate for and read a file into memory.
 @param path Path to the file.
@@ -351,6 +405,62 @@ Allocate for and read a file into memory.
 */
 long filedata(const char *path, uint8_t **buf);
 
+/** Number of values fileidentity() gives. */
+#define FILEIDENTITY_SIZE 5
+
+/**
+Tell one version of a file from another without reading it: device, inode, size, modification and change time.
+Copies made with 'cp -p', 'rsync -t' or tar keep the modification time but get a new inode and change time.
+On Windows the volume serial, file index and creation time stand in for device, inode and change time.
+@param path Path to a regular file.
+@param id Destination for FILEIDENTITY_SIZE values.
+@param settle Number of seconds the file must have been left alone to count as settled.
+@param psettled Assigned true if the file has not been modified or changed for settle seconds.
+A file still being written may change again within the same time stamp, its identity is not to be trusted yet.
+@return On success, returns E_NONE.
+@return If the file can not be examined, returns E_OPEN.
+*/
+int fileidentity(const char *path, uint64_t *id, int settle, bool *psettled);
+
+/**
+Map a regular file into memory, read only.
+@param path Path to the file.
+@param size Assigned the file size.
+@return On success, returns the mapped contents. Release them with fileunmap().
+@return If the file can not be opened or mapped, or is empty, returns NULL.
+*/
+const uint8_t *filemap(const char *path, size_t *size);
+
+/**
+Release a mapping made by filemap().
+@param data The mapped contents. NULL is ignored.
+@param size The file size given by filemap().
+*/
+void fileunmap(const uint8_t *data, size_t size);
+
+/** Whole contents of a file, mapped if possible. */
+struct filebuf {
+	const uint8_t *data;	/**< The contents. */
+	size_t size;			/**< Number of bytes in data[]. */
+	bool mapped;			/**< data[] is mapped rather than allocated. */
+};
+
+/**
+Get the contents of a file.
+Regular files are mapped with filemap(), standard input "-" and anything else that can not be mapped is read.
+@param fb The file buffer.
+@param path Path to the file.
+@return On success, returns E_NONE.
+@return On failure, returns a negative error code.
+*/
+int filebuf_open(struct filebuf *fb, const char *path);
+
+/**
+Release the contents from filebuf_open().
+@param fb The file buffer.
+*/
+void filebuf_close(struct filebuf *fb);
+
 #endif //__UTIL_H__
 /** @} */
 
@@ -0,0 +1,249 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup journal
+@{
+*/
+#include "stdafx.h"
+
+/** First line of every journal file. */
+static const char *journal_magic = "KUJI32JOURNAL 1";
+
+/** Size of one journal entry, the same as a kernal32 flash block. */
+#define JOURNAL_BLOCK 512
+
+/**
+	Read an existing journal file.
+	@param j The journal.
+	@return On success i.e. the file belongs to this MCU and image, returns E_NONE.
+	@return If there is no such file, returns E_NOTEXIST.
+	@return If the file is for something else, returns E_MISMATCH.
+	@return If the file is damaged or lacks its mcu or image line, returns E_MSGMALFORMED.
+*/
+static int journal_load(struct journal *j) {
+	char line[256];
+	char key[64];
+	char value[192];
+	char hex[2 * SHA256_SIZE + 1];
+	uint32_t address;
+	int linecount = 0;
+	bool hasmcu = false;
+	bool hasimage = false;
+	int rc = E_NONE;
+
+	FILE *F = fopen(j->path, "r");
+	if (F == NULL) {
+		return E_NOTEXIST;
+	}
+
+	sha256_hex(j->hash, hex);
+
+	while (rc == E_NONE && fgets(line, sizeof(line) - 1, F)) {
+		//A torn last line is expected after a power failure, it was never acknowledged.
+		if (strchr(line, '\n') == NULL) {
+			if (!feof(F)) rc = E_MSGMALFORMED;
+			break;
+		}
+
+		char *s = str_trim(line);
+		if (linecount++ == 0) {
+			if (strcmp(s, journal_magic) != 0) rc = E_MISMATCH;
+			continue;
+		}
+
+		if (sscanf(s, "%63s %191s", key, value) < 2) {
+			rc = E_MSGMALFORMED;
+			continue;
+		}
+
+		if (strcmp(key, "mcu") == 0) {
+			if (strcasecmp(value, j->mcu) != 0) rc = E_MISMATCH;
+			hasmcu = true;
+		} else if (strcmp(key, "image") == 0) {
+			if (strcmp(value, hex) != 0) rc = E_MISMATCH;
+			hasimage = true;
+		} else if (strcmp(key, "block") == 0) {
+			address = strtoint32(value, 16, &rc);
+			if (rc != E_NONE) {
+				rc = E_MSGMALFORMED;
+				continue;
+			}
+			if (address < j->base || (address - j->base) / JOURNAL_BLOCK >= j->nblocks || (address - j->base) % JOURNAL_BLOCK) {
+				rc = E_MISMATCH;
+				continue;
+			}
+			if (j->done[(address - j->base) / JOURNAL_BLOCK] == 0) {
+				j->done[(address - j->base) / JOURNAL_BLOCK] = 1;
+				j->ndone++;
+			}
+		}
+	}
+
+	fclose(F);
+
+	//Blocks are only known to be of this MCU and image when both say so.
+	if (rc == E_NONE && (!hasmcu || !hasimage)) {
+		rc = E_MSGMALFORMED;
+	}
+
+	if (rc != E_NONE) {
+		memset(j->done, 0x00, j->nblocks);
+		j->ndone = 0;
+	}
+
+	return rc;
+}
+
+int journal_new(struct journal **j, const char *path, const char *mcu, const uint8_t *hash, uint32_t base, uint32_t size) {
+	int rc;
+
+	assert(j);
+	assert(path);
+	assert(mcu);
+	assert(hash);
+
+	*j = (struct journal *)calloc(1, sizeof(struct journal));
+	assert(*j);
+
+	strncpy((*j)->path, path, sizeof((*j)->path) - 1);
+	strncpy((*j)->mcu, mcu, sizeof((*j)->mcu) - 1);
+	memcpy((*j)->hash, hash, SHA256_SIZE);
+	(*j)->base = base;
+	(*j)->nblocks = (size + JOURNAL_BLOCK - 1) / JOURNAL_BLOCK;
+	(*j)->done = (uint8_t *)calloc(1, (*j)->nblocks + 1);
+	assert((*j)->done);
+
+	rc = journal_load(*j);
+	if (rc == E_NONE) {
+		(*j)->resumable = ((*j)->ndone > 0);
+		LOGD("Journal '%s' has %u acknowledged blocks.", path, (*j)->ndone);
+	} else if (rc == E_MISMATCH) {
+		LOGW("Journal '%s' belongs to another MCU or image, it will be started over.", path);
+	} else if (rc == E_MSGMALFORMED) {
+		LOGW("Journal '%s' is damaged, it will be started over.", path);
+	}
+
+	return E_NONE;
+}
+
+void journal_free(struct journal **j) {
+	if (j && *j) {
+		if ((*j)->F) {
+			fclose((*j)->F);
+		}
+		free((*j)->done);
+		free(*j);
+		*j = NULL;
+	}
+}
+
+int journal_begin(struct journal *j, bool resume) {
+	char hex[2 * SHA256_SIZE + 1];
+
+	assert(j);
+
+	if (j->F) {
+		fclose(j->F);
+		j->F = NULL;
+	}
+
+	if (!resume) {
+		memset(j->done, 0x00, j->nblocks);
+		j->ndone = 0;
+		j->resumable = false;
+	}
+
+	//Written afresh from done[], so a torn last line never becomes a whole one.
+	//Cut short by a power failure, the file only forgets blocks.
+	j->F = fopen(j->path, "w");
+	if (j->F) {
+		fprintf(j->F, "%s\nmcu %s\nimage %s\n", journal_magic, j->mcu, sha256_hex(j->hash, hex));
+		for (uint32_t i = 0; i < j->nblocks; i++) {
+			if (j->done[i]) fprintf(j->F, "block 0x%06X\n", j->base + i * JOURNAL_BLOCK);
+		}
+	}
+
+	if (j->F == NULL) {
+		LOGE("Could not open journal '%s' for writing.", j->path);
+		return E_OPEN;
+	}
+
+	fflush(j->F);
+#ifndef __WIN32__
+	fsync(fileno(j->F));
+#endif
+
+	return E_NONE;
+}
+
+int journal_mark(struct journal *j, uint32_t address) {
+	uint32_t id;
+
+	assert(j);
+
+	if (address < j->base || (id = (address - j->base) / JOURNAL_BLOCK) >= j->nblocks) {
+		return E_RANGE;
+	}
+
+	if (j->F == NULL) {
+		return E_NOTOPEN;
+	}
+
+	if (fprintf(j->F, "block 0x%06X\n", address) < 0 || fflush(j->F) != 0) {
+		LOGE("Could not write to journal '%s'.", j->path);
+		return E_WRITE;
+	}
+
+#ifndef __WIN32__
+	//Make it stick even if the station loses power now.
+	fsync(fileno(j->F));
+#endif
+
+	if (j->done[id] == 0) {
+		j->done[id] = 1;
+		j->ndone++;
+	}
+
+	return E_NONE;
+}
+
+bool journal_isdone(struct journal *j, uint32_t address) {
+	if (j == NULL || address < j->base || (address - j->base) / JOURNAL_BLOCK >= j->nblocks) {
+		return false;
+	}
+	return j->done[(address - j->base) / JOURNAL_BLOCK] != 0;
+}
+
+int journal_finish(struct journal *j) {
+	assert(j);
+
+	if (j->F) {
+		fclose(j->F);
+		j->F = NULL;
+	}
+
+	if (remove(j->path) != 0) {
+		LOGW("Could not remove journal '%s'.", j->path);
+		return E_WRITE;
+	}
+
+	return E_NONE;
+}
+
+/** @} */
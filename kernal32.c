@@ -257,6 +257,9 @@ int kernal32_readflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf
 		return rc < 0 ? E_READ : E_MSGMALFORMED;
 	}
 
+	//CRC value as computed by us, summed while the rest of the block is still on the line.
+	uint16_t mycrc = 0;
+
 	int i = 0;
 	int retry = 30;
 	while (i < 0 || i < (int32_t)size) {
@@ -265,6 +268,7 @@ int kernal32_readflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf
 			LOGE("Error reading from '%s'.", state->serial->address);
 			return E_READ;
 		} else if (rc > 0) {
+			mycrc = crcitt_feed(mycrc, buf + i, rc);
 			i += rc;
 			retry = 30;
 		} else if (rc == 0) {
@@ -280,9 +284,6 @@ int kernal32_readflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf
 	//CRC value from MCU.
 	uint16_t pkcrc = ((csumok[0] << 8) & 0xFF00) | csumok[1];
 
-	//CRC value as computed by us.
-	uint16_t mycrc = crcitt(buf, size);
-
 	//Keep copy for caller.
 	if (pcrc) *pcrc = pkcrc;
 
@@ -300,6 +301,15 @@ int kernal32_readflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf
 }
 
 int kernal32_writeflash(struct kernal32 *state, uint32_t flash_base, uint8_t *buf, uint32_t size, uint16_t *pcsum) {
+	uint16_t crc = crcitt(buf, size);
+
+	//Keep copy for caller.
+	if (pcsum) *pcsum = crc;
+
+	return kernal32_writeflashcrc(state, flash_base, buf, size, crc);
+}
+
+int kernal32_writeflashcrc(struct kernal32 *state, uint32_t flash_base, uint8_t *buf, uint32_t size, uint16_t crc) {
 	int rc;
 
 	serial_purge(state->serial);
@@ -341,11 +351,6 @@ int kernal32_writeflash(struct kernal32 *state, uint32_t flash_base, uint8_t *bu
 		return E_WRITE;
 	}
 
-	uint16_t crc = crcitt(buf, size);
-
-	//Keep copy for caller.
-	if (pcsum) *pcsum = crc;
-
 	cmd[0] = crc >> 8;
 	cmd[1] = crc;
 	rc = serial_write(state->serial, cmd, 2);
@@ -373,5 +378,400 @@ int kernal32_writeflash(struct kernal32 *state, uint32_t flash_base, uint8_t *bu
 	return E_NONE;
 }
 
+/**
+	Write one coalesced block for kernal32_writeflashsrec().
+	@param state Kernal32 state.
+	@param flash_base Address of the block.
+	@param block The 512 byte block.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int kernal32_flushblock(struct kernal32 *state, uint32_t flash_base, uint8_t *block) {
+	uint16_t crc;
+	int rc;
+
+	//Records full of 0xFF leave erased flash as it is.
+	if (blank_isempty(block, 512)) {
+		return E_NONE;
+	}
+
+	rc = kernal32_writeflash(state, flash_base, block, 512, &crc);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+#ifdef __WIN32__
+	LOGI("Write sector 0x%06X CRC: %04X", flash_base, crc);
+#else
+	LOGR("\rSector 0x%06X CRC: %04X", flash_base, crc);
+#endif
+
+	return E_NONE;
+}
+
+int kernal32_checksrec(struct chipdef32 *chip, struct srec_list *reclist, uint32_t flash_base) {
+	uint32_t lastblock = 0;
+	uint32_t base;
+	bool seen = false;
+	struct srec *sr;
+
+	for (sr = reclist->head; sr; sr = sr->next) {
+		if (sr->type < 1 || sr->type > 3 || sr->count == 0) continue;
+
+		if (sr->address < flash_base || sr->address < chip->flash_start || sr->address + sr->count - 1 > chip->flash_end) {
+			LOGE("S-Record at 0x%06X is outside of flash (0x%06X - 0x%06X).", sr->address, chip->flash_start, chip->flash_end);
+			return E_RANGE;
+		}
+
+		//A sector is written once, so records must not go back to an earlier one.
+		base = flash_base + ((sr->address - flash_base) & ~0x1FF);
+		if (seen && base < lastblock) {
+			LOGD("S-Record at 0x%06X goes back to an earlier sector.", sr->address);
+			return E_ORDER;
+		}
+
+		lastblock = flash_base + ((sr->address + sr->count - 1 - flash_base) & ~0x1FF);
+		seen = true;
+	}
+
+	return E_NONE;
+}
+
+int kernal32_writeflashsrec(struct kernal32 *state, struct srec_list *reclist, uint32_t flash_base) {
+	uint8_t block[512];
+	uint32_t blockaddr = 0;
+	uint32_t addr, base, chunk;
+	bool dirty = false;
+	struct srec *sr;
+	int rc;
+
+	//Check the whole list first so a bad list never leaves the chip half written.
+	rc = kernal32_checksrec(state->chip, reclist, flash_base);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	for (sr = reclist->head; sr; sr = sr->next) {
+		if (sr->type < 1 || sr->type > 3) continue;
+
+		for (uint32_t n = 0; n < sr->count; n += chunk) {
+			addr = sr->address + n;
+			base = flash_base + ((addr - flash_base) & ~0x1FF);
+
+			//Moving on to another sector, write out the one we have.
+			if (!dirty || base != blockaddr) {
+				if (dirty) {
+					rc = kernal32_flushblock(state, blockaddr, block);
+					if (rc != E_NONE) {
+						return rc;
+					}
+				}
+
+				//Gaps are left erased.
+				memset(block, 0xFF, sizeof(block));
+				blockaddr = base;
+				dirty = true;
+			}
+
+			chunk = base + 512 - addr;
+			if (chunk > sr->count - n) {
+				chunk = sr->count - n;
+			}
+
+			memcpy(block + (addr - base), sr->data + n, chunk);
+		}
+	}
+
+	if (dirty) {
+		rc = kernal32_flushblock(state, blockaddr, block);
+		if (rc != E_NONE) {
+			return rc;
+		}
+	}
+
+	return E_NONE;
+}
+
+int kernal32_verifyflash(struct kernal32 *state, uint32_t flash_base, uint32_t size, uint16_t crc, uint16_t *pcrc) {
+	uint8_t buf[512];
+	uint16_t devcrc = 0;
+	int rc;
+
+	if (size == 0 || size > sizeof(buf)) {
+		return E_ARGUMENT;
+	}
+
+	rc = kernal32_readflash(state, flash_base, buf, size, &devcrc);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	//Keep copy for caller.
+	if (pcrc) *pcrc = devcrc;
+
+	return (devcrc == crc) ? E_NONE : E_MISMATCH;
+}
+
+/**************************************************** Non-blocking *****************************************************/
+
+/**
+	Finish the current operation.
+	@param m State machine.
+	@param result The final result.
+	@return Returns result.
+*/
+static int kernal32_finish(struct kernal32_machine *m, int result) {
+	m->phase = KERNAL32_PHASE_DONE;
+	m->result = result;
+	m->tx = NULL;
+	m->txlen = 0;
+	return result;
+}
+
+/**
+	Consume received bytes according to the command in progress.
+	@param m State machine.
+	@param rx Received bytes.
+	@param rxlen Number of bytes in rx[].
+	@param now Current time.
+*/
+static void kernal32_receive(struct kernal32_machine *m, const uint8_t *rx, int rxlen, double now) {
+	uint8_t c;
+	uint32_t n;
+
+	while (rxlen > 0 && m->phase != KERNAL32_PHASE_DONE) {
+		//Anything before the command has gone out is stale.
+		if (m->phase == KERNAL32_PHASE_COMMAND && m->cmd != KERNAL32_CMD_INTRO) return;
+
+		//Bulk copy the READ payload.
+		if (m->phase == KERNAL32_PHASE_PAYLOAD && m->cmd == KERNAL32_CMD_READFLASH) {
+			n = m->size - m->pos;
+			if (n > (uint32_t)rxlen) n = rxlen;
+			memcpy(m->buf + m->pos, rx, n);
+			m->rxcrc = crcitt_feed(m->rxcrc, rx, n);
+			m->pos += n;
+			rx += n;
+			rxlen -= n;
+			m->timeout = now + 2;
+			if (m->pos == m->size) m->phase = KERNAL32_PHASE_TRAILER;
+			continue;
+		}
+
+		c = *rx++;
+		rxlen--;
+
+		switch (m->cmd) {
+			case KERNAL32_CMD_INTRO:
+				if (c == KERNAL32_RESP_ACK) kernal32_finish(m, E_NONE);
+				break;
+
+			case KERNAL32_CMD_BLANKCHECK:
+				if (m->phase == KERNAL32_PHASE_TRAILER) {
+					//Address (4 bytes), data (4 bytes) and KERNAL32_RESP_ERRBLANK again.
+					m->rx[m->rxlen++] = c;
+					if (m->rxlen < 9) break;
+					if (m->rx[8] != KERNAL32_RESP_ERRBLANK) {
+						LOGE("Error: Did not receive final 0x34.");
+						kernal32_finish(m, E_MSGMALFORMED);
+						break;
+					}
+					LOGD("Chip is NOT blank. Address 0x%04X has value 0x%04X.",
+						m->rx[0] << 24 | m->rx[1] << 16 | m->rx[2] << 8 | m->rx[3],
+						m->rx[4] << 24 | m->rx[5] << 16 | m->rx[6] << 8 | m->rx[7]);
+					kernal32_finish(m, E_NONE);
+				} else if (c == KERNAL32_RESP_ACK) {
+					kernal32_finish(m, 1);	//Chip flash is blank.
+				} else if (c == KERNAL32_RESP_ERRBLANK) {
+					m->phase = KERNAL32_PHASE_TRAILER;
+					m->rxlen = 0;
+				} else if (c != KERNAL32_RESP_BUSY) {
+					LOGW("Erroneounus data received %02X", c);
+				}
+				break;
+
+			case KERNAL32_CMD_ERASECHIP:
+				//First byte is always the busy marker.
+				if (m->rxlen++ == 0) break;
+				if (c == KERNAL32_RESP_BUSY) {
+					m->timeout = now + 30;
+				} else if (c == KERNAL32_RESP_ACK) {
+					kernal32_finish(m, E_NONE);
+				} else if (c == KERNAL32_RESP_NAK) {
+					LOGE("ERROR - Chip NOT erased.");
+					kernal32_finish(m, E_FULL);
+				} else {
+					LOGE("Erroneous reply from MCU: 0x%02X", c);
+					kernal32_finish(m, E_MSGMALFORMED);
+				}
+				break;
+
+			case KERNAL32_CMD_READFLASH:
+				m->timeout = now + 2;
+				if (m->phase == KERNAL32_PHASE_PREAMBLE) {
+					//Busy marker followed by ACK.
+					if (c != (m->rxlen == 0 ? KERNAL32_RESP_BUSY : KERNAL32_RESP_ACK)) {
+						LOGE("ERROR: Did not receive acknowledge to READ command.");
+						kernal32_finish(m, E_MSGMALFORMED);
+						break;
+					}
+					if (++m->rxlen == 2) {
+						m->phase = KERNAL32_PHASE_PAYLOAD;
+						m->rxlen = 0;
+					}
+				} else {
+					//CRC (2 bytes) and final ACK.
+					m->rx[m->rxlen++] = c;
+					if (m->rxlen < 3) break;
+					m->crc = ((m->rx[0] << 8) & 0xFF00) | m->rx[1];
+					if (m->rx[2] != KERNAL32_RESP_ACK) {
+						LOGE("Error reading flash at 0x%06X.", m->address);
+						kernal32_finish(m, E_READ);
+					} else if (m->rxcrc != m->crc) {
+						LOGE("ERROR: CRC mismatch. Packet CRC 0x%04X is not 0x%04X.", m->crc, m->rxcrc);
+						kernal32_finish(m, E_MSGMALFORMED);
+					} else {
+						kernal32_finish(m, E_NONE);
+					}
+				}
+				break;
+
+			case KERNAL32_CMD_WRITEFLASH:
+				m->timeout = now + 2;
+				if (m->phase == KERNAL32_PHASE_PREAMBLE) {
+					//Busy and ready markers, then the block goes out.
+					if (++m->rxlen < 2) break;
+					m->rxlen = 0;
+					m->phase = KERNAL32_PHASE_PAYLOAD;
+					m->tx = m->buf;
+					m->txlen = m->size;
+				} else if (m->phase == KERNAL32_PHASE_TRAILER && m->txlen == 0) {
+					//Busy marker and confirmation.
+					m->rx[m->rxlen++] = c;
+					if (m->rxlen < 2) break;
+					if (m->rx[0] == KERNAL32_RESP_BUSY && m->rx[1] == KERNAL32_RESP_ACK) {
+						kernal32_finish(m, E_NONE);
+					} else if (m->rx[0] == KERNAL32_RESP_ERRCRC) {
+						LOGE("CRC error in communication.");
+						kernal32_finish(m, E_MSGMALFORMED);
+					} else {
+						LOGE("Error writing flash at 0x%06X.", m->address);
+						kernal32_finish(m, E_READ);
+					}
+				}
+				break;
+		}
+	}
+}
+
+int kernal32_begin(struct kernal32_machine *m, enum kernal32_cmdid cmd, uint32_t flash_base, uint8_t *buf, uint32_t size, double now) {
+	assert(m);
+
+	if (m->phase != KERNAL32_PHASE_IDLE && m->phase != KERNAL32_PHASE_DONE) {
+		return E_ALREADY;
+	}
+
+	if ((cmd == KERNAL32_CMD_READFLASH || cmd == KERNAL32_CMD_WRITEFLASH) && (buf == NULL || size == 0)) {
+		return E_ARGUMENT;
+	}
+
+	memset(m, 0x00, sizeof(struct kernal32_machine));
+
+	m->cmd = cmd;
+	m->address = flash_base;
+	m->buf = buf;
+	m->size = size;
+	m->result = E_WOULDBLOCK;
+	m->phase = KERNAL32_PHASE_COMMAND;
+
+	m->cmdbuf[0] = cmd;
+	m->tx = m->cmdbuf;
+
+	switch (cmd) {
+		case KERNAL32_CMD_INTRO:
+			m->txlen = 1;
+			m->timeout = now + 10;
+			break;
+		case KERNAL32_CMD_BLANKCHECK:
+		case KERNAL32_CMD_ERASECHIP:
+		case KERNAL32_CMD_READFLASH:
+		case KERNAL32_CMD_WRITEFLASH:
+			//Address is big endian.
+			m->cmdbuf[1] = (flash_base & 0xFF);
+			m->cmdbuf[2] = (flash_base >> 8) & 0xFF;
+			m->cmdbuf[3] = (flash_base >> 16) & 0xFF;
+			m->txlen = 4;
+			m->timeout = now + (cmd == KERNAL32_CMD_BLANKCHECK ? 1 : cmd == KERNAL32_CMD_ERASECHIP ? 30 : 2);
+			break;
+		default:
+			return E_ARGUMENT;
+	}
+
+	if (cmd == KERNAL32_CMD_READFLASH) {
+		memset(buf, 0xFF, size);
+	}
+
+	//INTRO is repeated every 100 ms until the kernal wakes up.
+	m->deadline = (cmd == KERNAL32_CMD_INTRO) ? now + 0.1 : m->timeout;
+
+	return E_NONE;
+}
+
+int kernal32_step(struct kernal32_machine *m, const uint8_t *rx, int rxlen, double now) {
+	assert(m);
+
+	if (m->phase == KERNAL32_PHASE_IDLE) return E_NOTREADY;
+	if (m->phase == KERNAL32_PHASE_DONE) return m->result;
+
+	//The command is out once the caller has sent every byte of it.
+	if (m->phase == KERNAL32_PHASE_COMMAND && m->txlen == 0) {
+		m->phase = KERNAL32_PHASE_PREAMBLE;
+	}
+
+	//The whole WRITE block is out, follow with its CRC.
+	if (m->phase == KERNAL32_PHASE_PAYLOAD && m->cmd == KERNAL32_CMD_WRITEFLASH && m->txlen == 0) {
+		m->crc = crcitt(m->buf, m->size);
+		m->cmdbuf[0] = m->crc >> 8;
+		m->cmdbuf[1] = m->crc;
+		m->tx = m->cmdbuf;
+		m->txlen = 2;
+		m->phase = KERNAL32_PHASE_TRAILER;
+		m->timeout = now + 2;
+	}
+
+	if (rx && rxlen > 0) {
+		kernal32_receive(m, rx, rxlen, now);
+		if (m->phase == KERNAL32_PHASE_DONE) return m->result;
+	}
+
+	if (now >= m->timeout) {
+		LOGE("ERROR: Time-out waiting for MCU.");
+		return kernal32_finish(m, E_TIMEOUT);
+	}
+
+	if (m->cmd == KERNAL32_CMD_INTRO) {
+		if (now >= m->deadline && m->txlen == 0) {
+			m->cmdbuf[0] = KERNAL32_CMD_INTRO;
+			m->tx = m->cmdbuf;
+			m->txlen = 1;
+			m->deadline = now + 0.1;
+		}
+		if (m->deadline > m->timeout) m->deadline = m->timeout;
+	} else {
+		m->deadline = m->timeout;
+	}
+
+	return E_WOULDBLOCK;
+}
+
+void kernal32_sent(struct kernal32_machine *m, int n) {
+	assert(m);
+
+	if (n <= 0) return;
+	if (n > m->txlen) n = m->txlen;
+
+	m->tx += n;
+	m->txlen -= n;
+}
+
 /** @} */
 
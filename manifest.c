@@ -0,0 +1,327 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+@addtogroup manifest
+@{
+*/
+#include "stdafx.h"
+
+/** First line of every manifest file. */
+static const char *manifest_magic = "KUJI32MANIFEST 2";
+
+/** Seconds a file must be left alone before a manifest describes it, as for the cache. */
+#define MANIFEST_SETTLE 2
+
+/** Keys a manifest has exactly once, the first MANIFEST_REQUIRED of them required. */
+static const char *manifest_keys[] = { "mcu", "base", "blocks", "source", "image", "raw" };
+
+/** Number of leading manifest_keys[] every manifest must have. */
+#define MANIFEST_REQUIRED 5
+
+int manifest_new(struct manifest **m, const char *mcu, uint32_t address_low, uint32_t address_high) {
+	assert(m);
+	assert(mcu);
+
+	*m = NULL;
+
+	if (address_low > address_high) {
+		return E_ARGUMENT;
+	}
+
+	struct manifest *mf = (struct manifest *)calloc(1, sizeof(struct manifest));
+	assert(mf);
+
+	strncpy(mf->mcu, mcu, sizeof(mf->mcu) - 1);
+	mf->base = address_low & ~(IMAGE_BLOCK - 1);
+	mf->nblocks = (address_high - mf->base) / IMAGE_BLOCK + 1;
+	mf->end = mf->base + mf->nblocks * IMAGE_BLOCK;
+	mf->next = mf->base;
+	mf->nonempty = (uint32_t *)calloc((mf->nblocks + 31) / 32, sizeof(uint32_t));
+	assert(mf->nonempty);
+	mf->crcs = (uint16_t *)calloc(mf->nblocks, sizeof(uint16_t));
+	assert(mf->crcs);
+
+	uint8_t blank[IMAGE_BLOCK];
+	memset(blank, 0xFF, sizeof(blank));
+	mf->blankcrc = crcitt(blank, sizeof(blank));
+	for (uint32_t i = 0; i < mf->nblocks; i++) {
+		mf->crcs[i] = mf->blankcrc;
+	}
+
+	sha256_init(&mf->ctx);
+
+	*m = mf;
+	return E_NONE;
+}
+
+int manifest_add(struct manifest *m, uint32_t address, const uint8_t *block) {
+	uint8_t be[4];
+
+	assert(m && !m->finished);
+
+	if (address % IMAGE_BLOCK || address < m->next || address >= m->end) {
+		LOGE("Block 0x%06X is out of order or outside of (0x%06X - 0x%06X).", address, m->base, m->end - 1);
+		return E_RANGE;
+	}
+	m->next = address + IMAGE_BLOCK;
+
+	if (blank_isempty(block, IMAGE_BLOCK)) {
+		return E_NONE;
+	}
+
+	uint32_t i = (address - m->base) / IMAGE_BLOCK;
+	m->nonempty[i / 32] |= (1u << (i % 32));
+	m->crcs[i] = crcitt((uint8_t *)block, IMAGE_BLOCK);
+	m->nfull++;
+
+	//Same as image_hash().
+	be[0] = address >> 24;
+	be[1] = address >> 16;
+	be[2] = address >> 8;
+	be[3] = address;
+	sha256_update(&m->ctx, be, sizeof(be));
+	sha256_update(&m->ctx, block, IMAGE_BLOCK);
+
+	return E_NONE;
+}
+
+void manifest_finish(struct manifest *m) {
+	if (!m->finished) {
+		sha256_final(&m->ctx, m->hash);
+		m->finished = true;
+	}
+}
+
+int manifest_fromimage(struct manifest **m, struct image *image, const char *mcu) {
+	assert(image && image->sealed);
+
+	int rc = manifest_new(m, mcu, image->base, image->end - 1);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	memcpy((*m)->nonempty, image->nonempty, (image->nblocks + 31) / 32 * sizeof(uint32_t));
+	memcpy((*m)->crcs, image->crcs, image->nblocks * sizeof(uint16_t));
+	(*m)->nfull = image->nfull;
+	image_hash(image, (*m)->hash);
+	(*m)->finished = true;
+
+	return E_NONE;
+}
+
+int manifest_save(struct manifest *m, const char *source, bool written) {
+	char path[MAX_PATH];
+	char hex[2 * SHA256_SIZE + 1];
+	uint64_t id[FILEIDENTITY_SIZE];
+	bool settled = false;
+	bool ok;
+
+	assert(m && m->finished);
+
+	if (fileidentity(source, id, MANIFEST_SETTLE, &settled) != E_NONE) {
+		LOGE("Could not examine '%s'.", source);
+		return E_OPEN;
+	}
+
+	//A file still being written by someone else may change within the same time stamps.
+	if (!settled && !written) {
+		LOGE("File '%s' was changed less than %d seconds ago, try again in a moment.", source, MANIFEST_SETTLE);
+		return E_NOTREADY;
+	}
+
+	snprintf(path, sizeof(path), "%s%s", source, MANIFEST_SUFFIX);
+	FILE *F = fopen(path, "w");
+	if (F == NULL) {
+		LOGE("Could not open file '%s' for writing.", path);
+		return E_OPEN;
+	}
+
+	ok = fprintf(F, "%s\nmcu %s\nbase 0x%06X\nblocks %u\nsource %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\nimage %s\n",
+		manifest_magic, m->mcu, m->base, m->nblocks, id[0], id[1], id[2], id[3], id[4], sha256_hex(m->hash, hex)) > 0;
+
+	if (ok && m->raw) {
+		ok = fprintf(F, "raw 0x%06X\n", m->rawbase) > 0;
+	}
+
+	for (uint32_t i = 0; ok && i < m->nblocks; i++) {
+		if (m->nonempty[i / 32] & (1u << (i % 32))) {
+			ok = fprintf(F, "crc 0x%06X %04X\n", m->base + i * IMAGE_BLOCK, m->crcs[i]) > 0;
+		}
+	}
+
+	if (fclose(F) != 0) ok = false;
+
+	if (!ok) {
+		LOGE("Error writing to file '%s'.", path);
+		remove(path);
+		return E_WRITE;
+	}
+
+	LOGD("Wrote manifest '%s' with %u blocks.", path, m->nfull);
+	return E_NONE;
+}
+
+int manifest_load(struct manifest **m, const char *source, const char *mcu, uint32_t address_low, uint32_t address_high, bool raw, uint32_t rawbase) {
+	char path[MAX_PATH];
+	char line[256];
+	char key[32];
+	char value[96];
+	char extra[96];
+	uint64_t id[FILEIDENTITY_SIZE];
+	uint64_t recorded[FILEIDENTITY_SIZE];
+	bool settled;
+	uint32_t address, i;
+	uint32_t seen = 0;
+	bool first = true;
+	int rc = E_NONE;
+	int status;
+	int n;
+
+	assert(m);
+
+	*m = NULL;
+
+	//Standard input has no file to keep a manifest next to.
+	if (strcmp(source, "-") == 0) {
+		return E_NOTEXIST;
+	}
+
+	snprintf(path, sizeof(path), "%s%s", source, MANIFEST_SUFFIX);
+	FILE *F = fopen(path, "r");
+	if (F == NULL) {
+		return E_NOTEXIST;
+	}
+
+	rc = manifest_new(m, mcu, address_low, address_high);
+
+	while (rc == E_NONE && fgets(line, sizeof(line) - 1, F)) {
+		char *s = str_trim(line);
+		if (first) {
+			if (strcmp(s, manifest_magic) != 0) rc = E_MSGMALFORMED;
+			first = false;
+			continue;
+		}
+
+		n = sscanf(s, "%31s %95s %95s", key, value, extra);
+		if (n < 2) {
+			rc = E_MSGMALFORMED;
+			continue;
+		}
+
+		//A key given twice could hide the one that does not match.
+		for (size_t k = 0; k < sizeof(manifest_keys) / sizeof(manifest_keys[0]); k++) {
+			if (strcmp(key, manifest_keys[k]) != 0) continue;
+			if (seen & (1u << k)) rc = E_MSGMALFORMED;
+			seen |= (1u << k);
+		}
+
+		if (rc != E_NONE) {
+			continue;
+		} else if (strcmp(key, "mcu") == 0) {
+			if (strcasecmp(value, mcu) != 0) rc = E_MISMATCH;
+		} else if (strcmp(key, "base") == 0) {
+			if ((uint32_t)strtoint64(value, 16, &status) != (*m)->base || status != E_NONE) rc = E_MISMATCH;
+		} else if (strcmp(key, "blocks") == 0) {
+			if ((uint32_t)strtoint64(value, 10, &status) != (*m)->nblocks || status != E_NONE) rc = E_MISMATCH;
+		} else if (strcmp(key, "source") == 0) {
+			//A file changed, replaced or copied since the manifest was written is described no more.
+			if (sscanf(s, "source %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+				&recorded[0], &recorded[1], &recorded[2], &recorded[3], &recorded[4]) != FILEIDENTITY_SIZE) {
+				rc = E_MSGMALFORMED;
+			} else if (fileidentity(source, id, MANIFEST_SETTLE, &settled) != E_NONE || memcmp(id, recorded, sizeof(id)) != 0) {
+				rc = E_MISMATCH;
+			}
+		} else if (strcmp(key, "raw") == 0) {
+			(*m)->raw = true;
+			(*m)->rawbase = (uint32_t)strtoint64(value, 16, &status);
+			if (status != E_NONE) rc = E_MSGMALFORMED;
+		} else if (strcmp(key, "image") == 0) {
+			if (strlen(value) != 2 * SHA256_SIZE || hex_decode((*m)->hash, value, SHA256_SIZE, NULL) != E_NONE) rc = E_MSGMALFORMED;
+			(*m)->finished = true;
+		} else if (strcmp(key, "crc") == 0) {
+			address = (uint32_t)strtoint64(value, 16, &status);
+			if (n < 3 || status != E_NONE || address % IMAGE_BLOCK || address < (*m)->base || address >= (*m)->end) {
+				rc = E_MSGMALFORMED;
+				continue;
+			}
+
+			i = (address - (*m)->base) / IMAGE_BLOCK;
+			if ((*m)->nonempty[i / 32] & (1u << (i % 32))) {
+				rc = E_MSGMALFORMED;
+				continue;
+			}
+			(*m)->nonempty[i / 32] |= (1u << (i % 32));
+			(*m)->crcs[i] = strtoint32(extra, 16, &status);
+			(*m)->nfull++;
+			if (status != E_NONE) rc = E_MSGMALFORMED;
+		}
+	}
+
+	fclose(F);
+
+	//Every key must be there, a manifest cut short is no manifest.
+	if (rc == E_NONE && (seen & ((1u << MANIFEST_REQUIRED) - 1)) != (1u << MANIFEST_REQUIRED) - 1) {
+		rc = E_MSGMALFORMED;
+	}
+
+	//Raw binary is only the same image when placed at the same address.
+	if (rc == E_NONE && ((*m)->raw != raw || (raw && (*m)->rawbase != rawbase))) {
+		rc = E_MISMATCH;
+	}
+
+	if (rc == E_MSGMALFORMED) {
+		LOGW("Manifest '%s' is malformed, it is not used.", path);
+	} else if (rc == E_MISMATCH) {
+		LOGD("Manifest '%s' is for another MCU or version of the file.", path);
+	}
+
+	if (rc != E_NONE) {
+		manifest_free(m);
+	}
+
+	return rc;
+}
+
+bool manifest_isempty(struct manifest *m, uint32_t address) {
+	if (address < m->base || address >= m->end) {
+		return true;
+	}
+
+	uint32_t i = (address - m->base) / IMAGE_BLOCK;
+	return (m->nonempty[i / 32] & (1u << (i % 32))) == 0;
+}
+
+uint16_t manifest_crc(struct manifest *m, uint32_t address) {
+	if (address < m->base || address >= m->end) {
+		return m->blankcrc;
+	}
+
+	return m->crcs[(address - m->base) / IMAGE_BLOCK];
+}
+
+void manifest_free(struct manifest **m) {
+	if (m && *m) {
+		free((*m)->nonempty);
+		free((*m)->crcs);
+		free(*m);
+		*m = NULL;
+	}
+}
+
+/** @} */
@@ -335,7 +335,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.\n";
 const char *help = "\
 \n\
 --------------------------------\n\
-Usage: ./kuji32 -m <mcu> -p <com> [-t <seconds>] [-v] [-d] [-c <freq>] [-r <file>] [-e] [-w <file>]\n\
+Usage: ./kuji32 -m <mcu> -p <com> [-t <seconds>] [-v] [-d] [-c <freq>] [-r <file>] [-e] [-w <file>] [--verify] [--skip-identical] [--journal <file>] [--compile-image <file>] [--cache <dir>] [--base <addr>] [--srec-type <1-3>] [--srec-length <n>] [--srec-end] [--diff <file>] [--manifest]\n\
   -h         Print help and exit.\n\
   -H         Print all supported MCUs and exit.\n\
   -V         Print application version and exit.\n\
@@ -347,15 +347,33 @@ Usage: ./kuji32 -m <mcu> -p <com> [-t <seconds>] [-v] [-d] [-c <freq>] [-r <file
   -m <mcu>   Select MCU by name e.g. 'mb90f598g'. Case-insensitive.\n\
   -c <freq>  Select target crystal (megahertz) e.g 4, 8, 16 etc. Default is 4 Mhz.\n\
   -b         Blank-check and exit immediately after.\n\
-  -r <file>  Read MCU flash and write it file as S-Records.\n\
+  -r <file>  Read MCU flash and write it file as S-Records. A block CRC manifest <file>.manifest is written next to it.\n\
   -e         Erase MCU flash.\n\
-  -w <file>  Write S-Record file to MCU flash.\n\
+  -w <file>  Write S-Record, Intel HEX or ELF file to MCU flash. Use - to read from standard input.\n\
+  --verify             Read back and compare each block right after it is programmed.\n\
+  --skip-identical     Compare MCU flash with the file given to -w first and skip erase and write if they match.\n\
+  --journal <file>     Record acknowledged blocks in <file>. A later run resumes from it without erasing.\n\
+  --compile-image <file> Compile the file given to -w into an image for the MCU, write it to <file> and exit.\n\
+  --cache <dir>        Keep parsed files in <dir> so loading the same file again skips parsing.\n\
+  --base <addr>        The file given to -w is raw binary starting at <addr>.\n\
+  --srec-type <1-3>    Write S1, S2 or S3 records with -r. Default is S2.\n\
+  --srec-length <n>    Write up to <n> data bytes per record with -r, 1 - 250. Default is 16.\n\
+  --srec-end           End the file written with -r with a record count and a termination record.\n\
+  --diff <file>        Compare <file> with the file given to -w, or with MCU flash if there is no -w, and exit.\n\
+  --manifest           Write a block CRC manifest next to the file given to -w and exit.\n\
 \n\
 Example: ./kuji32 -m mb91f362 -p1 -e -w firmware.mhx\n\
 \n\
 To print out supported MCUs: ./kuji32 -H\n\
 \n\
-Note: The file must be standard Motorola S-Record.\n\
+To compile S-Records into an image that loads instantly: ./kuji32 -m mb91f362 -w firmware.mhx --compile-image firmware.k32\n\
+\n\
+To see how much a new firmware changes the chip: ./kuji32 -m mb91f362 -p1 --diff firmware.mhx\n\
+\n\
+Manifests spare --diff and --skip-identical from parsing: ./kuji32 -m mb91f362 -w firmware.mhx --manifest\n\
+\n\
+Note: The file must be standard Motorola S-Record, Intel HEX, 32 bit ELF or an image made with --compile-image.\n\
+With --base <addr> the file is raw binary starting at that address, e.g. --base 0x80000.\n\
 \n\
 Exit codes:\n\
 --------------\n\
@@ -373,6 +391,7 @@ Exit codes:\n\
 12 : Error initializing Kernal interface.\n\
 13 : Error blank-checking MCU.\n\
 14 : Error erasing MCU.\n\
+15 : Flash contents did not match the image after programming.\n\
 ";
 
 /**
@@ -386,20 +405,174 @@ void print_help() {
 	);
 }
 
+/** Identifiers of options that only have a long name. */
+enum longopt32 {
+	OPT_VERIFY = 0x100,		/**< '--verify'. */
+	OPT_SKIPIDENTICAL,		/**< '--skip-identical'. */
+	OPT_JOURNAL,			/**< '--journal <file>'. */
+	OPT_COMPILEIMAGE,		/**< '--compile-image <file>'. */
+	OPT_CACHE,				/**< '--cache <dir>'. */
+	OPT_BASE,				/**< '--base <addr>'. */
+	OPT_SRECTYPE,			/**< '--srec-type <1-3>'. */
+	OPT_SRECLENGTH,			/**< '--srec-length <n>'. */
+	OPT_SRECEND,			/**< '--srec-end'. */
+	OPT_DIFF,				/**< '--diff <file>'. */
+	OPT_MANIFEST,			/**< '--manifest'. */
+};
+
+/** Long command line options for getopt_long(). */
+static struct option longopts32[] = {
+	{"verify",			no_argument,	NULL,	OPT_VERIFY},
+	{"skip-identical",	no_argument,	NULL,	OPT_SKIPIDENTICAL},
+	{"journal",			required_argument,	NULL,	OPT_JOURNAL},
+	{"compile-image",	required_argument,	NULL,	OPT_COMPILEIMAGE},
+	{"cache",			required_argument,	NULL,	OPT_CACHE},
+	{"base",			required_argument,	NULL,	OPT_BASE},
+	{"srec-type",		required_argument,	NULL,	OPT_SRECTYPE},
+	{"srec-length",		required_argument,	NULL,	OPT_SRECLENGTH},
+	{"srec-end",		no_argument,	NULL,	OPT_SRECEND},
+	{"diff",			required_argument,	NULL,	OPT_DIFF},
+	{"manifest",		no_argument,	NULL,	OPT_MANIFEST},
+	{NULL,				0,				NULL,	0}
+};
+
+/** Accumulates mismatching blocks into address ranges for reporting. */
+struct mismatch32 {
+	uint32_t start;		/**< First address of the current range. */
+	uint32_t end;		/**< One past the last address of the current range. */
+	int blocks;			/**< Total number of mismatching blocks. */
+	int ranges;			/**< Total number of ranges reported. */
+};
+
 /**
-	Test if all bytes in a given buffer are 0xFF.
-	@param buf Buffer of bytes to test.
-	@param size Size of buf[].
-	@return If buffer only contains 0xFF, returns true.
+	Log the current mismatch range, if any.
+	@param mm Mismatch accumulator.
 */
-bool isflashbufempty(uint8_t *buf, int size);
+static void mismatch32_flush(struct mismatch32 *mm) {
+	if (mm->end > mm->start) {
+		LOGE("Mismatch 0x%06X - 0x%06X (%u bytes).", mm->start, mm->end - 1, mm->end - mm->start);
+		mm->ranges++;
+	}
+	mm->start = mm->end = 0;
+}
+
+/**
+	Add a mismatching block, extending the current range if it is adjacent.
+	@param mm Mismatch accumulator.
+	@param address Address of the block.
+	@param size Size of the block.
+*/
+static void mismatch32_add(struct mismatch32 *mm, uint32_t address, uint32_t size) {
+	if (mm->end == 0 || address != mm->end) {
+		mismatch32_flush(mm);
+		mm->start = address;
+	}
+	mm->end = address + size;
+	mm->blocks++;
+}
+
+/** Timings collected over one session, printed when it ends. */
+struct report32 {
+	double start;		/**< get_ticks() when the session started. */
+	double load;		/**< Seconds spent loading the image, negative if none was loaded. */
+};
+
+/**
+	Log the session report.
+	@param report Collected timings.
+*/
+static void report32_print(struct report32 *report) {
+	LOGI("== Session Report ==");
+	if (report->load >= 0) {
+		LOGI("Image load:   %.3f s", report->load);
+	}
+	LOGI("Session:      %.3f s", get_ticks() - report->start);
+}
+
+/**
+	Compare flash contents to an image manifest, block by block, using only the CRC from the read path.
+	Blocks that hold data in the image are compared first as they are the most likely to differ.
+	@param kernal Kernal32 state.
+	@param manifest Manifest of the image to compare against.
+	@param chip MCU descriptor.
+	@return If flash matches the image, returns E_NONE.
+	@return If flash differs, returns E_MISMATCH.
+	@return On failure, returns a negative error code.
+*/
+static int compare32(struct kernal32 *kernal, struct manifest *manifest, struct chipdef32 *chip) {
+	uint32_t addr;
+	int pass;
+	int rc;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (addr = chip->flash_start; addr < chip->flash_end; addr += 512) {
+			bool empty = manifest_isempty(manifest, addr);
+			if (empty != (pass == 1)) continue;
+
+			rc = kernal32_verifyflash(kernal, addr, 512, manifest_crc(manifest, addr), NULL);
+			if (rc != E_NONE) {
+				if (rc == E_MISMATCH) LOGD("Sector 0x%06X differs.", addr);
+				return rc;
+			}
+
+#ifdef __WIN32__
+			LOGI("Compared sector 0x%06X", addr);
+#else
+			LOGR("\rCompared sector 0x%06X", addr);
+#endif
+		}
+	}
+
+	return E_NONE;
+}
+
+/**
+	Confirm that the blocks recorded in a journal are in flash and that the
+	first block not recorded, the one that was in flight, is still blank.
+	@param kernal Kernal32 state.
+	@param image The image being programmed.
+	@param journal The journal.
+	@return If the device matches the journal, returns E_NONE.
+	@return If it does not, returns E_MISMATCH.
+	@return On failure, returns a negative error code.
+*/
+static int resume32(struct kernal32 *kernal, struct image *image, struct journal *journal) {
+	uint8_t block[512];
+	uint32_t addr;
+	int rc;
+
+	for (addr = image_next(image, image->base); addr < image->end; addr = image_next(image, addr + IMAGE_BLOCK)) {
+		if (!journal_isdone(journal, addr)) continue;
+
+		rc = kernal32_verifyflash(kernal, addr, 512, image_crc(image, addr), NULL);
+		if (rc != E_NONE) {
+			if (rc == E_MISMATCH) LOGD("Journaled sector 0x%06X differs.", addr);
+			return rc;
+		}
+
+#ifdef __WIN32__
+		LOGI("Confirmed sector 0x%06X", addr);
+#else
+		LOGR("\rConfirmed sector 0x%06X", addr);
+#endif
+	}
 
-inline bool isflashbufempty(uint8_t *buf, int size) {
-	while (size--) {
-		if (*buf != 0xFF) return false;
-		buf++;
+	for (addr = image_next(image, image->base); addr < image->end; addr = image_next(image, addr + IMAGE_BLOCK)) {
+		if (journal_isdone(journal, addr)) continue;
+
+		rc = kernal32_readflash(kernal, addr, block, sizeof(block), NULL);
+		if (rc != E_NONE) {
+			return rc;
+		}
+
+		if (!blank_isempty(block, sizeof(block))) {
+			LOGD("Sector 0x%06X was partially written.", addr);
+			return E_MISMATCH;
+		}
+		break;
 	}
-	return true;
+
+	return E_NONE;
 }
 
 /**
@@ -413,11 +586,12 @@ Process command line parameters.
 int process_params32(int argc, char *argv[], struct params32 *params) {
 	int id;
 	int opt;
+	int rc;
 
 	memset(params, 0x00, sizeof(struct params32));
 	params->argstr = "hHVdt:l:v:p:m:c:ber:w:";
 
-	while ((opt = getopt(argc, argv, params->argstr)) != -1) {
+	while ((opt = getopt_long(argc, argv, params->argstr, longopts32, NULL)) != -1) {
 		switch (opt) {
 			case 'h':
 				print_help();
@@ -508,13 +682,83 @@ int process_params32(int argc, char *argv[], struct params32 *params) {
 				}
 				break;
 
+			case OPT_VERIFY:
+				params->verify = true;
+				break;
+
+			case OPT_SKIPIDENTICAL:
+				params->skipidentical = true;
+				break;
+
+			case OPT_JOURNAL:
+				if (optarg && optarg[0]) {
+					params->journalpath = optarg;
+				}
+				break;
+
+			case OPT_COMPILEIMAGE:
+				if (optarg && optarg[0]) {
+					params->compilepath = optarg;
+				}
+				break;
+
+			case OPT_CACHE:
+				if (optarg && optarg[0]) {
+					params->cachedir = optarg;
+				}
+				break;
+
+			case OPT_BASE: {
+				int64_t base = strtoint64(optarg, 0, &rc);
+				if (rc != E_NONE || base < 0 || base > 0xFFFFFFFFLL) {
+					LOGE("ERROR: Invalid option '%s' to --base. This is not an address.", optarg);
+					return FAIL_ARGUMENT;
+				}
+				params->base = base;
+				params->hasbase = true;
+				break;
+			}
+
+			case OPT_SRECTYPE:
+				id = strtoint32(optarg, 10, &rc);
+				if (rc != E_NONE || id < 1 || id > 3) {
+					LOGE("ERROR: Invalid option '%s' to --srec-type. Use 1, 2 or 3.", optarg);
+					return FAIL_ARGUMENT;
+				}
+				params->srectype = id;
+				break;
+
+			case OPT_SRECLENGTH:
+				id = strtoint32(optarg, 10, &rc);
+				if (rc != E_NONE || id < 1 || id > SREC_LENGTH_MAX) {
+					LOGE("ERROR: Invalid option '%s' to --srec-length. Use 1 - %d.", optarg, SREC_LENGTH_MAX);
+					return FAIL_ARGUMENT;
+				}
+				params->sreclength = id;
+				break;
+
+			case OPT_SRECEND:
+				params->srecend = true;
+				break;
+
+			case OPT_DIFF:
+				if (optarg && optarg[0]) {
+					params->diffpath = optarg;
+				}
+				break;
+
+			case OPT_MANIFEST:
+				params->manifest = true;
+				break;
+
 			case '?':
 				LOGE("Argument error!");
 				return FAIL_ARGUMENT;
 		}
 	}
 
-	if (params->comarg == NULL) {
+	//Compiling an image, writing a manifest or comparing two files does not talk to the MCU.
+	if (params->comarg == NULL && params->compilepath == NULL && !(params->manifest && params->write) && !(params->diffpath && params->write)) {
 		LOGE("Missing or invalid option '-p'.");
 		print_help();
 		return FAIL_ARGUMENT;
@@ -554,6 +798,419 @@ int process_params32(int argc, char *argv[], struct params32 *params) {
 	return E_NONE;
 }
 
+/** Formats accepted by '-w'. */
+enum format32 {
+	FORMAT_SREC = 0,	/**< Motorola S-Record. */
+	FORMAT_IHEX,		/**< Intel HEX. */
+	FORMAT_ELF,			/**< 32 bit ELF executable. */
+	FORMAT_BINARY,		/**< Raw binary at the address given to '--base'. */
+	FORMAT_IMAGE,		/**< Image made by compile32(). */
+};
+
+/**
+	Tell the format of a file from its first bytes.
+	Standard input is only peeked at, so it can still be read as a stream. One byte is all it can take back,
+	so a compiled image there is told by the first letter of IMAGE_MAGIC, which no text format starts with.
+	@param params Parsed parameters.
+	@param path Path to the file, '-' for standard input.
+	@return Returns the format, S-Record if nothing else matches.
+*/
+static enum format32 format32(struct params32 *params, const char *path) {
+	uint8_t head[sizeof(((struct image_header *)0)->magic)];
+	size_t n = 0;
+	FILE *F;
+	int c;
+
+	if (params->hasbase) {
+		return FORMAT_BINARY;
+	}
+
+	if (strcmp(path, "-") == 0) {
+		//Text formats may start with white space, the readers skip it anyway.
+		do {
+			c = getc(stdin);
+		} while (c != EOF && isspace(c));
+		ungetc(c, stdin);
+
+		if (c == 0x7F) return FORMAT_ELF;
+		if (c == IMAGE_MAGIC[0]) return FORMAT_IMAGE;
+		return (c == ':') ? FORMAT_IHEX : FORMAT_SREC;
+	}
+
+	F = fopen(path, "rb");
+	if (F) {
+		n = fread(head, 1, sizeof(head), F);
+		fclose(F);
+	}
+
+	if (n == sizeof(head) && image_probe(head)) return FORMAT_IMAGE;
+	if (n >= 4 && elf32_magic(head)) return FORMAT_ELF;
+
+	//Text formats may start with white space.
+	for (size_t i = 0; i < n; i++) {
+		if (head[i] == ':') return FORMAT_IHEX;
+		if (!isspace(head[i])) break;
+	}
+
+	return FORMAT_SREC;
+}
+
+/**
+	Load an image in whichever format it is, text formats through the cache if one was given.
+	A compiled image must be for the same MCU and fit its flash.
+	@param params Parsed parameters.
+	@param path Path to the file, '-' for standard input.
+	@param image The dereferenced pointer is assigned to the loaded image.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+static int loadimage32(struct params32 *params, const char *path, struct image **image) {
+	uint32_t low = params->chip->flash_start;
+	uint32_t high = params->chip->flash_end;
+	cache_reader reader = srec_readimage;
+	char mcu[32];
+	int rc;
+
+	switch (format32(params, path)) {
+		case FORMAT_BINARY:
+			return image_readbinary(image, path, params->base, low, high);
+
+		case FORMAT_ELF:
+			return elf32_readimage(image, path, low, high);
+
+		case FORMAT_IHEX:
+			reader = ihex_readimage;
+			break;
+
+		case FORMAT_SREC:
+			break;
+
+		case FORMAT_IMAGE:
+			//Compiled images are mapped, not read.
+			if (strcmp(path, "-") == 0) {
+				LOGE("A compiled image can not be read from standard input, give its file name to -w.");
+				return E_TYPE;
+			}
+
+			rc = image_load(image, path, mcu);
+			if (rc != E_NONE) {
+				return rc;
+			}
+
+			if (strcasecmp(mcu, mcu32_name(params->chip->mcu)) != 0) {
+				LOGE("Image '%s' was compiled for '%s', not '%s'.", path, mcu, mcu32_name(params->chip->mcu));
+				image_free(image);
+				return E_MISMATCH;
+			}
+
+			if ((*image)->base < low || (*image)->end - 1 > high) {
+				LOGE("Image '%s' does not fit the flash of '%s'.", path, mcu32_name(params->chip->mcu));
+				image_free(image);
+				return E_RANGE;
+			}
+			return E_NONE;
+	}
+
+	if (params->cachedir) {
+		return cache_readimage(image, params->cachedir, path, reader, mcu32_name(params->chip->mcu), low, high);
+	}
+	return reader(image, path, low, high);
+}
+
+/**
+	Compile the file given to '-w' into an image file that loads without parsing.
+	@param params Parsed parameters.
+	@return On success, returns E_NONE.
+	@return On failure, returns one of enum failures32.
+*/
+static int compile32(struct params32 *params) {
+	struct report32 report = { .start = get_ticks(), .load = -1 };
+	struct image *image = NULL;
+	int rc;
+
+	if (params->srecpath == NULL) {
+		LOGE("ERROR: Missing or malformed option to '-w'.");
+		print_help();
+		return FAIL_ARGUMENT;
+	}
+
+	rc = loadimage32(params, params->srecpath, &image);
+	if (rc != E_NONE) {
+		LOGE("ERROR: Could not load image from file '%s'.", params->srecpath);
+		return FAIL_SRECORD;
+	}
+	report.load = get_ticks() - report.start;
+
+	rc = image_save(image, params->compilepath, mcu32_name(params->chip->mcu));
+	if (rc != E_NONE) {
+		image_free(&image);
+		return FAIL_WRITE;
+	}
+
+	LOGI("== Image Compiled: %u blocks to '%s' ==", image->nfull, params->compilepath);
+	image_free(&image);
+
+	report32_print(&report);
+	return E_NONE;
+}
+
+/**
+	Load the manifest of a file given to '-w' or '--diff'.
+	@param params Parsed parameters.
+	@param path Path to the file.
+	@param manifest The dereferenced pointer is assigned to the manifest.
+	@return On success, returns E_NONE.
+	@return If there is no usable manifest, returns a negative error code with *manifest assigned NULL.
+*/
+static int loadmanifest32(struct params32 *params, const char *path, struct manifest **manifest) {
+	return manifest_load(manifest, path, mcu32_name(params->chip->mcu), params->chip->flash_start, params->chip->flash_end, params->hasbase, params->base);
+}
+
+/**
+	Write a manifest next to the file given to '-w'.
+	@param params Parsed parameters.
+	@return On success, returns E_NONE.
+	@return On failure, returns one of enum failures32.
+*/
+static int manifest32(struct params32 *params) {
+	struct report32 report = { .start = get_ticks(), .load = -1 };
+	struct image *image = NULL;
+	struct manifest *manifest = NULL;
+	int rc;
+
+	rc = loadimage32(params, params->srecpath, &image);
+	if (rc != E_NONE) {
+		LOGE("ERROR: Could not load image from file '%s'.", params->srecpath);
+		return FAIL_SRECORD;
+	}
+	report.load = get_ticks() - report.start;
+
+	rc = manifest_fromimage(&manifest, image, mcu32_name(params->chip->mcu));
+	image_free(&image);
+	if (rc != E_NONE) {
+		return FAIL_SRECORD;
+	}
+	manifest->raw = params->hasbase;
+	manifest->rawbase = params->base;
+
+	rc = manifest_save(manifest, params->srecpath, false);
+	if (rc != E_NONE) {
+		manifest_free(&manifest);
+		return FAIL_WRITE;
+	}
+
+	LOGI("== Manifest Written: %u blocks of '%s' ==", manifest->nfull, params->srecpath);
+	manifest_free(&manifest);
+
+	report32_print(&report);
+	return E_NONE;
+}
+
+/**
+	Read the whole flash into an image.
+	@param kernal Kernal32 state.
+	@param chip MCU descriptor.
+	@param image The dereferenced pointer is assigned to the image.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *image assigned NULL.
+*/
+static int readimage32(struct kernal32 *kernal, struct chipdef32 *chip, struct image **image) {
+	uint8_t buff[512];
+	uint32_t addr;
+
+	int rc = image_new(image, chip->flash_start, chip->flash_end);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	for (addr = chip->flash_start; addr < chip->flash_start + chip->flash_size; addr += 512) {
+		rc = kernal32_readflash(kernal, addr, buff, sizeof(buff), NULL);
+		if (rc == E_NONE && !blank_isempty(buff, sizeof(buff))) {
+			rc = image_write(*image, addr, buff, sizeof(buff));
+		}
+		if (rc != E_NONE) {
+			image_free(image);
+			return rc;
+		}
+
+#ifdef __WIN32__
+		LOGI("Received sector 0x%06X", addr);
+#else
+		LOGR("\rReceived sector 0x%06X", addr);
+#endif
+	}
+
+	image_seal(*image);
+	return E_NONE;
+}
+
+/**
+	Read the whole flash into a manifest. Only the CRCs and the hash are kept.
+	@param kernal Kernal32 state.
+	@param chip MCU descriptor.
+	@param manifest The dereferenced pointer is assigned to the manifest.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code with *manifest assigned NULL.
+*/
+static int readmanifest32(struct kernal32 *kernal, struct chipdef32 *chip, struct manifest **manifest) {
+	uint8_t buff[512];
+	uint32_t addr;
+
+	int rc = manifest_new(manifest, mcu32_name(chip->mcu), chip->flash_start, chip->flash_end);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	for (addr = chip->flash_start; addr < chip->flash_start + chip->flash_size; addr += 512) {
+		rc = kernal32_readflash(kernal, addr, buff, sizeof(buff), NULL);
+		if (rc == E_NONE) {
+			rc = manifest_add(*manifest, addr, buff);
+		}
+		if (rc != E_NONE) {
+			manifest_free(manifest);
+			return rc;
+		}
+
+#ifdef __WIN32__
+		LOGI("Received sector 0x%06X", addr);
+#else
+		LOGR("\rReceived sector 0x%06X", addr);
+#endif
+	}
+
+	manifest_finish(*manifest);
+	return E_NONE;
+}
+
+/**
+	Compare the file given to '--diff' by manifests, if it has one.
+	The other side is the manifest of the file given to '-w' or, without '-w', of MCU flash.
+	@param params Parsed parameters.
+	@param kernal Kernal32 state to read flash with, NULL to compare two files.
+	@param isblank The chip is known to be blank and need not be read.
+	@param diff The dereferenced pointer is assigned to the result.
+	@return On success, returns E_NONE.
+	@return If a manifest is missing or stale or the manifests can not tell, returns E_NOTEXIST with *diff assigned NULL.
+	@return If reading flash fails, returns a negative error code with *diff assigned NULL.
+*/
+static int diffmanifest32(struct params32 *params, struct kernal32 *kernal, bool isblank, struct diff **diff) {
+	const char *mcu = mcu32_name(params->chip->mcu);
+	uint32_t low = params->chip->flash_start;
+	uint32_t high = params->chip->flash_end;
+	struct manifest *from = NULL;
+	struct manifest *to = NULL;
+	int rc;
+
+	*diff = NULL;
+
+	if (loadmanifest32(params, params->diffpath, &to) != E_NONE) {
+		return E_NOTEXIST;
+	}
+
+	if (kernal == NULL) {
+		rc = loadmanifest32(params, params->srecpath, &from);
+		if (rc != E_NONE) rc = E_NOTEXIST;
+	} else if (isblank) {
+		rc = manifest_new(&from, mcu, low, high);
+		if (rc == E_NONE) manifest_finish(from);
+	} else {
+		LOGR("[INF]: Reading ");
+		rc = readmanifest32(kernal, params->chip, &from);
+		LOGR("\n");
+	}
+
+	if (rc == E_NONE) {
+		LOGD("Comparing manifests of '%s' and '%s'.", kernal ? "MCU flash" : params->srecpath, params->diffpath);
+		rc = diff_manifests(diff, from, to);
+		if (rc != E_NONE) rc = E_NOTEXIST;
+	}
+
+	manifest_free(&from);
+	manifest_free(&to);
+	return rc;
+}
+
+/**
+	Compare the file given to '--diff' with the file given to '-w' or, without '-w', with MCU flash.
+	@param params Parsed parameters.
+	@param kernal Kernal32 state to read flash with, NULL to compare two files.
+	@param isblank The chip is known to be blank and need not be read.
+	@return On success, returns E_NONE.
+	@return On failure, returns one of enum failures32.
+*/
+static int diff32(struct params32 *params, struct kernal32 *kernal, bool isblank) {
+	struct image *from = NULL;
+	struct image *to = NULL;
+	struct diff *diff = NULL;
+	uint32_t baud = params->chip->bps2[params->freqid] > 0 ? params->chip->bps2[params->freqid] : 115200;
+	int rc;
+
+	//Manifests make parsing or keeping the payloads unnecessary.
+	rc = diffmanifest32(params, kernal, isblank, &diff);
+	if (rc != E_NONE && rc != E_NOTEXIST) {
+		LOGE("Error receiving flash contents.");
+		return FAIL_READ;
+	}
+
+	if (diff) {
+		diff_print(diff, kernal ? "MCU flash" : params->srecpath, params->diffpath, baud);
+		diff_free(&diff);
+		return E_NONE;
+	}
+
+	if (kernal == NULL) {
+		rc = loadimage32(params, params->srecpath, &from);
+		if (rc != E_NONE) {
+			LOGE("ERROR: Could not load image from file '%s'.", params->srecpath);
+			return FAIL_SRECORD;
+		}
+	} else if (isblank) {
+		rc = image_new(&from, params->chip->flash_start, params->chip->flash_end);
+		if (rc != E_NONE) {
+			return FAIL_READ;
+		}
+		image_seal(from);
+	} else {
+		LOGR("[INF]: Reading ");
+		rc = readimage32(kernal, params->chip, &from);
+		LOGR("\n");
+		if (rc != E_NONE) {
+			LOGE("Error receiving flash contents.");
+			return FAIL_READ;
+		}
+	}
+
+	rc = loadimage32(params, params->diffpath, &to);
+	if (rc != E_NONE) {
+		LOGE("ERROR: Could not load image from file '%s'.", params->diffpath);
+		image_free(&from);
+		return FAIL_SRECORD;
+	}
+
+	rc = diff_images(&diff, from, to);
+	image_free(&from);
+	image_free(&to);
+	if (rc != E_NONE) {
+		return FAIL_SRECORD;
+	}
+
+	diff_print(diff, kernal ? "MCU flash" : params->srecpath, params->diffpath, baud);
+	diff_free(&diff);
+
+	return E_NONE;
+}
+
+/**
+	Fill in the S-Record format for '-r' from the parameters.
+	@param params Parsed parameters.
+	@param format Destination.
+*/
+static void srecformat32(struct params32 *params, struct srec_format *format) {
+	format->rectype = params->srectype ? params->srectype : 2;
+	format->length = params->sreclength ? params->sreclength : SREC_LENGTH_DEFAULT;
+	format->terminate = params->srecend;
+}
+
 int process32(struct params32 *params) {
 	int bps = 0;
 	int id = 0;
@@ -561,15 +1218,31 @@ int process32(struct params32 *params) {
 	int bytes = 0;
 	uint16_t csum = 0;
 	struct serial serial;
+	struct srec_format format;
 
 	char compath[256];
 
 	bool isblank;
 
+	struct report32 report = { .start = get_ticks(), .load = -1 };
+
 #ifdef __WIN32__
 	int comid = 0;
 #endif
 
+	if (params->compilepath) {
+		return compile32(params);
+	}
+
+	if (params->manifest && params->write) {
+		return manifest32(params);
+	}
+
+	//Two files are compared without the MCU.
+	if (params->diffpath && params->write) {
+		return diff32(params, NULL, false);
+	}
+
 	memset(compath, 0x00, sizeof(compath));
 
 	//NOTE, bps follows the clock, this is configured in 'chipdef32.ini'.
@@ -604,6 +1277,12 @@ int process32(struct params32 *params) {
 		return FAIL_ARGUMENT;
 	}
 
+	srecformat32(params, &format);
+	if (params->read && srec_checkformat(&format, params->chip->flash_end) != E_NONE) {
+		LOGE("ERROR: Flash of '%s' can not be read into S%d records.", mcu32_name(params->chip->mcu), format.rectype);
+		return FAIL_ARGUMENT;
+	}
+
 	//Open up serial port for birom.
 	memset(&serial, 0x00, sizeof(struct serial));
 	LOGD("Compath: '%s'", compath);
@@ -719,6 +1398,15 @@ int process32(struct params32 *params) {
 	}
 	isblank = (rc == 1);
 
+	//Compare flash to a file and leave it at that.
+	if (params->diffpath) {
+		rc = diff32(params, kernal, isblank);
+		LOGD("========== KERNAL32 DONE ==========");
+		kernal32_free(&kernal);
+		serial_close(&serial);
+		return rc;
+	}
+
 	//Exit early if chip is full and there are no operations or
 	//if chip is empty and operations would not be possible.
 	if (
@@ -745,23 +1433,47 @@ int process32(struct params32 *params) {
 			return FAIL_BLANK;
 		}
 
-		//Sector by sector!
-		uint8_t *buff = calloc(1, params->chip->flash_size * 2);
-		assert(buff);
+		//Sector by sector, each one is encoded and written while the next is read.
+		//The manifest of the dump is collected on the way.
+		uint8_t buff[512];
+		struct srec_writer *writer = NULL;
+		struct manifest *manifest = NULL;
+
+		rc = srec_writer_new(&writer, params->savepath, &format);
+		if (rc != E_NONE) {
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_SRECORD;
+		}
+
+		manifest_new(&manifest, mcu32_name(params->chip->mcu), params->chip->flash_start, params->chip->flash_end);
 
-		bytes = 0;
 		csum = 0;
 
 		LOGR("[INF]: Reading ");
-		for (uint32_t addr = params->chip->flash_start; addr < params->chip->flash_start + params->chip->flash_size; addr += 0x200, bytes += 512) {
-			rc = kernal32_readflash(kernal, addr, buff + bytes, 512, &csum);
+		for (uint32_t addr = params->chip->flash_start; addr < params->chip->flash_start + params->chip->flash_size; addr += 0x200) {
+			rc = kernal32_readflash(kernal, addr, buff, 512, &csum);
 			if (rc != E_NONE) {
 				LOGE("Error receiving flash contents.");
+				manifest_free(&manifest);
+				srec_writer_free(&writer);
 				kernal32_free(&kernal);
 				serial_close(&serial);
 				return FAIL_READ;
 			}
 
+			manifest_add(manifest, addr, buff);
+
+			rc = srec_writer_put(writer, addr, buff, 512);
+			if (rc != E_NONE) {
+				LOGE("Error serializing S-Record.");
+				manifest_free(&manifest);
+				srec_writer_free(&writer);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_SRECORD;
+			}
+
 #ifdef __WIN32__
 			LOGI("Receiving 512 bytes from sector 0x%06X, last CRC16 0x%04X", addr, csum);
 #else
@@ -773,36 +1485,180 @@ int process32(struct params32 *params) {
 		LOGR("\n");
 #endif
 
-		rc = srec_writefilebin(buff, bytes, params->savepath, 2, params->chip->flash_start);
+		rc = srec_writer_finish(writer);
+		srec_writer_free(&writer);
 		if (rc != E_NONE) {
 			LOGE("Error serializing S-Record.");
+			manifest_free(&manifest);
 			kernal32_free(&kernal);
 			serial_close(&serial);
 			return FAIL_SRECORD;
 		}
 
-		free(buff);
-		buff = NULL;
+		//The dump is good without its manifest, it only takes longer to compare.
+		manifest_finish(manifest);
+		if (strcmp(params->savepath, "-") != 0 && manifest_save(manifest, params->savepath, true) != E_NONE) {
+			LOGW("No manifest was written for '%s'.", params->savepath);
+		}
+		manifest_free(&manifest);
 
 		LOGI("== Chip Read Successfully ==");
 	}
 
+	//Leave the chip alone if it already holds the image.
+	//A manifest next to the file spares parsing it unless the chip turns out to differ.
+	struct image *image = NULL;
+	struct srec_list *reclist = NULL;
+	if (params->write && params->skipidentical && !isblank) {
+		struct manifest *manifest = NULL;
+		double loadstart = get_ticks();
+
+		rc = loadmanifest32(params, params->srecpath, &manifest);
+		if (rc == E_NONE) {
+			LOGD("Loaded manifest of '%s'.", params->srecpath);
+		} else {
+			rc = loadimage32(params, params->srecpath, &image);
+			if (rc == E_NONE) {
+				rc = manifest_fromimage(&manifest, image, mcu32_name(params->chip->mcu));
+			}
+			if (rc != E_NONE) {
+				LOGE("ERROR: Could not load image from file '%s'.", params->srecpath);
+				image_free(&image);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_SRECORD;
+			}
+		}
+		report.load = get_ticks() - loadstart;
+
+		LOGR("[INF]: Comparing ");
+		rc = compare32(kernal, manifest, params->chip);
+		LOGR("\n");
+		manifest_free(&manifest);
+		if (rc == E_NONE) {
+			LOGI("== Chip Is Up To Date ==");
+			report32_print(&report);
+			LOGD("========== KERNAL32 DONE ==========");
+			image_free(&image);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return E_NONE;
+		} else if (rc != E_MISMATCH) {
+			LOGE("Error reading flash contents.");
+			image_free(&image);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_READ;
+		}
+		LOGI("Chip differs from '%s'.", params->srecpath);
+	}
+
+	//Load S-Records before touching flash so we have something to compare against.
+	//A plain write needs no flat image, the records go straight to the chip.
+	double loadstart = get_ticks();
+	if (params->write && !params->verify && !params->skipidentical && !params->journalpath && !params->cachedir && format32(params, params->srecpath) == FORMAT_SREC) {
+		rc = srec_readfile(&reclist, params->srecpath);
+		if (rc != E_NONE) {
+			LOGE("ERROR: Could not interpret S-Records from file '%s'.", params->srecpath);
+			srec_freelist(&reclist);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_SRECORD;
+		}
+
+		LOGD("Loaded S-Records from '%s'.", params->srecpath);
+
+		//Look before erasing. Records out of order are fine, they only need the whole image.
+		//The image is made from the records in hand, standard input can not be read twice.
+		rc = kernal32_checksrec(params->chip, reclist, params->chip->flash_start);
+		if (rc == E_ORDER) {
+			LOGW("S-Records in '%s' are not in ascending order, placing them in an image.", params->srecpath);
+			rc = srec_listimage(&image, reclist, params->srecpath, params->chip->flash_start, params->chip->flash_end);
+			srec_freelist(&reclist);
+		}
+		if (rc != E_NONE) {
+			srec_freelist(&reclist);
+			LOGE("ERROR: Could not interpret S-Records from file '%s'.", params->srecpath);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_SRECORD;
+		}
+	} else if (params->write && image == NULL) {
+		//Collect flash data from the file into a sparse image covering the flash.
+		rc = loadimage32(params, params->srecpath, &image);
+		if (rc != E_NONE) {
+			LOGE("ERROR: Could not load image from file '%s'.", params->srecpath);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_SRECORD;
+		}
+
+		LOGD("Loaded S-Records from '%s'.", params->srecpath);
+	}
+	if (params->write) {
+		report.load = (report.load > 0 ? report.load : 0) + get_ticks() - loadstart;
+	}
+
+	//Pick up where an interrupted run left off, if the journal agrees with the chip.
+	struct journal *journal = NULL;
+	bool resume = false;
+	if (params->write && params->journalpath) {
+		uint8_t hash[SHA256_SIZE];
+		image_hash(image, hash);
+
+		journal_new(&journal, params->journalpath, mcu32_name(params->chip->mcu), hash, params->chip->flash_start, params->chip->flash_size);
+
+		if (journal->resumable && !isblank) {
+			LOGR("[INF]: Checking journal ");
+			rc = resume32(kernal, image, journal);
+			LOGR("\n");
+			if (rc == E_NONE) {
+				LOGI("Resuming, %u blocks already programmed.", journal->ndone);
+				resume = true;
+			} else if (rc == E_MISMATCH) {
+				LOGW("Journal '%s' does not match the chip, starting over.", params->journalpath);
+			} else {
+				LOGE("Error reading flash contents.");
+				journal_free(&journal);
+				image_free(&image);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_READ;
+			}
+		}
+
+		rc = journal_begin(journal, resume);
+		if (rc != E_NONE) {
+			journal_free(&journal);
+			image_free(&image);
+			kernal32_free(&kernal);
+			serial_close(&serial);
+			return FAIL_ARGUMENT;
+		}
+	}
+
 	//Return early is chip is full and trying to write without erasing first.
-	if (!isblank && params->write && !params->erase) {
+	if (!isblank && params->write && !params->erase && !resume) {
 		LOGE("Error: Trying to write into an already full MCU. Did you forget to add '-e' argument?");
 		LOGD("========== KERNAL32 DONE ==========");
+		journal_free(&journal);
+		srec_freelist(&reclist);
+		image_free(&image);
 		kernal32_free(&kernal);
 		serial_close(&serial);
 		return FAIL_NOTBLANK;
 	}
 
 	//Erase chip.
-	if (params->erase && !isblank) {
+	if (params->erase && !isblank && !resume) {
 		LOGR("[INF]: Erasing ");
 		rc = kernal32_erasechip(kernal, params->chip->flash_start);
 		if (rc != E_NONE) {
 			LOGR("\n");
 			LOGE("ERROR: Could not erase flash!");
+			journal_free(&journal);
+			srec_freelist(&reclist);
+			image_free(&image);
 			kernal32_free(&kernal);
 			serial_close(&serial);
 			return FAIL_ERASE;
@@ -811,29 +1667,27 @@ int process32(struct params32 *params) {
 		LOGI("== Chip Erased ==");
 	}
 
-	//Program S-Records.
-	if (params->write) {
-		uint8_t *buf = NULL;
-
-		//Copy flash data from S-Records in file into a linear buffer.
-		//The buffer is already 2^24 bytes so we can index it directly from params->chip->flash_start to params->chip->flash_end inclusively.
-		rc = srec_readfilebin(&buf, params->srecpath, params->chip->flash_start, params->chip->flash_end);
-		if (rc != E_NONE || buf == NULL) {
-			LOGE("ERROR: Could not interpret S-Records from file '%s'.", params->srecpath);
+	//Program S-Records straight from the list.
+	if (params->write && reclist) {
+		LOGR("[INF]: Writing ");
+		rc = kernal32_writeflashsrec(kernal, reclist, params->chip->flash_start);
+		srec_freelist(&reclist);
+#ifndef __WIN32__
+		LOGR("\n");
+#endif
+		if (rc != E_NONE) {
 			kernal32_free(&kernal);
 			serial_close(&serial);
-			return FAIL_SRECORD;
+			return FAIL_WRITE;
+		} else {
+			LOGI("== Chip Programmed Successfully ==");
 		}
+	}
 
-		LOGD("Loaded S-Records from '%s'.", params->srecpath);
-
-		//Calculate rough size of transfer.
-		uint32_t size = 0;
-		for (uint32_t addr = params->chip->flash_start; addr < params->chip->flash_end; addr += 512, bytes += 512) {
-			if (isflashbufempty(buf + addr, 512) == false) {
-				size += 512;
-			}
-		}
+	//Program S-Records.
+	if (params->write && image) {
+		//Size of transfer is known from loading the image.
+		uint32_t size = image->nfull * IMAGE_BLOCK;
 
 #ifdef DEBUGGING
 		LOGD("Writing %d bytes...", size);
@@ -841,23 +1695,53 @@ int process32(struct params32 *params) {
 		LOGR("[INF]: Writing ");
 #endif
 
-		//Write out linear buffer into MCU flash in 512 byte chunks.
+		//Write out the image into MCU flash in 512 byte chunks.
 		bytes = 0;
 		uint16_t crc;
-		for (uint32_t addr = params->chip->flash_start; addr < params->chip->flash_end; addr += 512, bytes += 512) {
-			if (isflashbufempty(buf + addr, 512) == false) {
-				rc = kernal32_writeflash(kernal, addr, buf + addr, 512, &crc);
-				if (rc != E_NONE) {
-					kernal32_free(&kernal);
-					serial_close(&serial);
-					return FAIL_WRITE;
-				}
+		struct mismatch32 mismatch;
+		memset(&mismatch, 0x00, sizeof(mismatch));
+		for (uint32_t addr = image_next(image, image->base); addr < image->end; addr = image_next(image, addr + IMAGE_BLOCK)) {
+			bytes += IMAGE_BLOCK;
+			if (journal_isdone(journal, addr)) continue;
+
+			//The CRC is known from loading, the kernal only needs the data.
+			crc = image_crc(image, addr);
+			rc = kernal32_writeflashcrc(kernal, addr, (uint8_t *)image_block(image, addr), IMAGE_BLOCK, crc);
+			if (rc != E_NONE) {
+				journal_free(&journal);
+				image_free(&image);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_WRITE;
+			}
+
+			if (journal && journal_mark(journal, addr) != E_NONE) {
+				journal_free(&journal);
+				image_free(&image);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_WRITE;
+			}
 
 #ifdef __WIN32__
-				LOGI("Write sector 0x%06X CRC: %04X", addr, crc);
+			LOGI("Write sector 0x%06X CRC: %04X (%u%%)", addr, crc, (unsigned)((uint64_t)bytes * 100 / size));
 #else
-				LOGR("\rSector 0x%06X CRC: %04X", addr, crc);
+			LOGR("\rSector 0x%06X CRC: %04X (%u%%)", addr, crc, (unsigned)((uint64_t)bytes * 100 / size));
 #endif
+
+			//Read back while we are at it, only the CRC goes into the comparison.
+			if (params->verify) {
+				rc = kernal32_verifyflash(kernal, addr, 512, image_crc(image, addr), NULL);
+				if (rc == E_MISMATCH) {
+					mismatch32_add(&mismatch, addr, 512);
+				} else if (rc != E_NONE) {
+					LOGE("Error reading back sector 0x%06X.", addr);
+					journal_free(&journal);
+					image_free(&image);
+					kernal32_free(&kernal);
+					serial_close(&serial);
+					return FAIL_READ;
+				}
 			}
 		}
 
@@ -865,8 +1749,25 @@ int process32(struct params32 *params) {
 		LOGR("\n");
 #endif
 
-		free(buf);
-		buf = NULL;
+		image_free(&image);
+
+		if (params->verify) {
+			mismatch32_flush(&mismatch);
+			if (mismatch.blocks > 0) {
+				LOGE("== Verify Failed: %d blocks in %d ranges differ ==", mismatch.blocks, mismatch.ranges);
+				journal_free(&journal);
+				kernal32_free(&kernal);
+				serial_close(&serial);
+				return FAIL_VERIFY;
+			}
+			LOGI("== Chip Verified ==");
+		}
+
+		//Programming is complete, the journal has nothing left to say.
+		if (journal) {
+			journal_finish(journal);
+			journal_free(&journal);
+		}
 
 		LOGI("== Chip Programmed Successfully ==");
 
@@ -874,6 +1775,8 @@ int process32(struct params32 *params) {
 
 	kernal32_free(&kernal);
 
+	report32_print(&report);
+
 	LOGD("========== KERNAL32 DONE ==========");
 
 	serial_close(&serial);
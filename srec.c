@@ -25,41 +25,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /**************************************************** Private *****************************************************/
 
 //Forward declarations of inline methods.
-char *srec_parse_header(char *s, struct srec *rec);
-char *srec_parse_count(char *s, struct srec *rec);
-char *srec_parse_address(char *s, struct srec *rec);
-char *srec_parse_data(char *s, struct srec *rec);
-char *srec_parse_checksum(char *s, struct srec *rec);
-
-/** Convert a single digit from base 16 to base 10. */
-uint8_t hexval(uint8_t c) {
-	uint8_t values[16] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
-	if (c >= '0' && c <= '9') c -= 48; else if (c >= 'A' && c <= 'F') c -= 55; else if (c >= 'a' && c <= 'f') c -= 87; else return 0;
-	return values[c];
-}
-
-/** Convert two hexadecimal digits into one 8 bit decimal value. */
-uint8_t fromhex2(uint8_t a, uint8_t b) { return (hexval(a) * 16) + hexval(b); }
-
-/** Convert four hexadecimal digits into one 16 bit decimal value. */
-uint16_t fromhex4(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { return (hexval(a) * 4096) + (hexval(b) * 256) + (hexval(c) * 16) + hexval(d); }
-
-/** Convert four hexadecimal digits into one 24 bit decimal value. */
-uint32_t fromhex6(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f) { return (hexval(a) * 1048576) + (hexval(b) * 65536) + (hexval(c) * 4096) + (hexval(d) * 256) + (hexval(e) * 16) + hexval(f); }
-
-/** Convert eight hexadecimal digits into one 32 bit decimal value. */
-uint32_t fromhex8(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t h) { return (hexval(a) * 268435456) + (hexval(b) * 16777216) + (hexval(c) * 1048576) + (hexval(d) * 65536) + (hexval(e) * 4096) + (hexval(f) * 256) + (hexval(g) * 16) + hexval(h); }
+const char *srec_parse_header(const char *s, const char *end, struct srec *rec);
+const char *srec_parse_count(const char *s, const char *end, struct srec *rec, uint8_t *sum);
+const char *srec_parse_address(const char *s, const char *end, struct srec *rec, uint8_t *sum);
+const char *srec_parse_data(const char *s, const char *end, struct srec *rec, uint8_t *sum);
+const char *srec_parse_checksum(const char *s, const char *end, struct srec *rec);
 
 /**
 	Parse header from S-Record string.
 	@param s Source string.
+	@param end One past the last character of the record.
 	@param rec Destination S-Record.
 	@return On success, returns a pointer to the next field.
-	@return On failure, returns a negative error code.
+	@return On failure, returns NULL.
 */
-inline char *srec_parse_header(char *s, struct srec *rec) {
-	if (s == NULL || rec == NULL || s[0] != 'S' || s[1] == '\0') {
-		LOGD("Invalid S-Record header: '%s'", s);
+inline const char *srec_parse_header(const char *s, const char *end, struct srec *rec) {
+	if (s == NULL || rec == NULL || end - s < 2 || s[0] != 'S' || s[1] < '0' || s[1] > '9') {
 		return NULL;
 	}
 	rec->type = s[1] - 48;
@@ -69,30 +50,45 @@ inline char *srec_parse_header(char *s, struct srec *rec) {
 /**
 	Parse count from S-Record string.
 	@param s Source string.
+	@param end One past the last character of the record.
 	@param rec Destination S-Record.
+	@param sum Running checksum.
 	@return On success, returns a pointer to the next field.
-	@return On failure, returns a negative error code.
+	@return On failure, returns NULL.
 */
-inline char *srec_parse_count(char *s, struct srec *rec) {
-	if (s == NULL || rec == NULL || s[0] == '\0' || s[1] == '\0') {
-		LOGD("Invalid S-Record count: '%s'");
+inline const char *srec_parse_count(const char *s, const char *end, struct srec *rec, uint8_t *sum) {
+	if (s == NULL || rec == NULL || end - s < 2) {
+		return NULL;
+	}
+
+	int count = hex_byte(s);
+	if (count < 0) {
+		return NULL;
+	}
+	rec->count = count;
+	*sum += count;
+
+	//Count covers address, data and checksum.
+	if (end - s != 2 + rec->count * 2) {
 		return NULL;
 	}
 
-	rec->count = fromhex2(s[0], s[1]);
 	return s + 2;
 }
 
 /**
 	Parse address from S-Record string.
 	@param s Source string.
+	@param end One past the last character of the record.
 	@param rec Destination S-Record.
+	@param sum Running checksum.
 	@return On success, returns a pointer to the next field.
-	@return On failure, returns a negative error code.
+	@return On failure, returns NULL.
 */
-inline char *srec_parse_address(char *s, struct srec *rec) {
-	if (s == NULL || rec == NULL || s[0] == '\0' || s[1] == '\0' || s[2] == '\0' || s[3] == '\0') {
-		LOGD("Invalid S-Record address: '%s'", s);
+inline const char *srec_parse_address(const char *s, const char *end, struct srec *rec, uint8_t *sum) {
+	int width;
+
+	if (s == NULL || rec == NULL) {
 		return NULL;
 	}
 
@@ -102,44 +98,48 @@ inline char *srec_parse_address(char *s, struct srec *rec) {
 		case 5:
 		case 9:
 			//2 byte address.
-			rec->address = fromhex4(s[0], s[1], s[2], s[3]);
-			rec->count -= 2;
-			return s + 4;
+			width = 2;
+			break;
 		case 2:
+		case 6:
 		case 8:
 			//3 byte address.
-			if (s[4] == '\0' || s[5] == '\0') {
-				LOGD("Invalid S-Record address: '%s'", s);
-				return NULL;
-			}
-			rec->address = fromhex6(s[0], s[1], s[2], s[3], s[4], s[5]);
-			rec->count -= 3;
-			return s + 6;
+			width = 3;
+			break;
 		case 3:
 		case 7:
-			if (s[4] == '\0' || s[5] == '\0' || s[6] == '\0' || s[7] == '\0') {
-				LOGD("Invalid S-Record address: '%s'", s);
-				return NULL;
-			}
 			//4 byte address.
-			rec->address = fromhex8(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
-			rec->count -= 4;
-			return s + 8;
+			width = 4;
+			break;
+		default:
+			return NULL;
 	}
 
-	return NULL;
+	//Room for the address and the checksum.
+	if (rec->count < width + 1 || end - s < (width + 1) * 2) {
+		return NULL;
+	}
+
+	if (hex_field(s, width, &rec->address) != E_NONE) {
+		return NULL;
+	}
+	*sum += (rec->address >> 24) + (rec->address >> 16) + (rec->address >> 8) + rec->address;
+
+	rec->count -= width;
+	return s + width * 2;
 }
 
 /**
 	Parse data from S-Record string.
 	@param s Source string.
+	@param end One past the last character of the record.
 	@param rec Destination S-Record.
+	@param sum Running checksum.
 	@return On success, returns a pointer to the next field.
-	@return On failure, returns a negative error code.
+	@return On failure, returns NULL.
 */
-inline char *srec_parse_data(char *s, struct srec *rec) {
-	if (s == NULL || rec == NULL || s[0] == '\0' || rec->count > strlen(s) * 2) {
-		LOGD("Invalid S-Record data: '%s'", s);
+inline const char *srec_parse_data(const char *s, const char *end, struct srec *rec, uint8_t *sum) {
+	if (s == NULL || rec == NULL || rec->count == 0 || end - s < rec->count * 2) {
 		return NULL;
 	}
 
@@ -147,127 +147,512 @@ inline char *srec_parse_data(char *s, struct srec *rec) {
 	rec->count--;
 
 	//Read and interpret data.
-	for (int b = 0; b < rec->count; b++, s += 2) {
-		rec->data[b] = fromhex2(s[0], s[1]);
-	};
+	if (hex_decode(rec->data, s, rec->count, sum) != E_NONE) {
+		return NULL;
+	}
 
-	return s;
+	return s + rec->count * 2;
 }
 
 /**
 	Parse checksum from S-Record string.
 	@param s Source string.
+	@param end One past the last character of the record.
 	@param rec Destination S-Record.
 	@return On success, returns a pointer to the next field.
-	@return On failure, returns a negative error code.
+	@return On failure, returns NULL.
 */
-inline char *srec_parse_checksum(char *s, struct srec *rec) {
-	if (s == NULL || rec == NULL || s[0] == '\0' || s[1] == '\0') {
-		LOGD("Invalid S-Record checksum: '%s'", s);
+inline const char *srec_parse_checksum(const char *s, const char *end, struct srec *rec) {
+	if (s == NULL || rec == NULL || end - s < 2) {
 		return NULL;
 	}
 
-	rec->csum = fromhex2(s[0], s[1]);
+	int csum = hex_byte(s);
+	if (csum < 0) {
+		return NULL;
+	}
+	rec->csum = csum;
 	return s + 2;
 }
 
-/**************************************************** Public *****************************************************/
+/**
+	Parse one S-Record in place.
+	The record does not need to be NUL terminated, nothing past end is read.
+	Fields are decoded, length checked and summed in a single pass.
+	@param s First character of the record.
+	@param end One past the last character of the record.
+	@param rec Destination S-Record.
+	@return On success, returns E_NONE.
+	@return If the record is malformed, returns E_MSGMALFORMED.
+	@return If the checksum does not match, returns E_CRC.
+*/
+static int srec_parse(const char *s, const char *end, struct srec *rec) {
+	//Checksum is calculated over count, address and data.
+	uint8_t csum = 0;
+
+	rec->next = NULL;
+
+	s = srec_parse_header(s, end, rec);
+	s = srec_parse_count(s, end, rec, &csum);
+	s = srec_parse_address(s, end, rec, &csum);
+	s = srec_parse_data(s, end, rec, &csum);
+	s = srec_parse_checksum(s, end, rec);
+	if (s == NULL) {
+		return E_MSGMALFORMED;
+	}
 
-int srec_readfile(struct srec **reclist, const char *filepath) {
-	static char line[256];
+	csum = (~csum);
 
-	FILE *F = fopen(filepath, "r");
-	if (F == NULL) {
-		LOGE("ERROR: Could not open file '%s' for reading.", filepath);
-		return E_OPEN;
-	}
+	return (csum == rec->csum) ? E_NONE : E_CRC;
+}
 
-	memset(line, 0x00, sizeof(line));
+/**
+	Scan text for S-Records, one per line.
+	Nothing is logged here so the same code can run on worker threads, see srec_scanerror().
+	@param text The text.
+	@param len Number of characters in text[].
+	@param linecount Line number of the last line scanned. Updated as lines are consumed.
+	@param visit Callback for every record.
+	@param ctx Passed to visit.
+	@return On success, returns E_NONE.
+	@return If a line is malformed or fails its checksum, returns E_MSGMALFORMED or E_CRC with *linecount at that line.
+	@return If visit fails, returns its error code.
+*/
+static int srec_scanlines(const char *text, size_t len, int *linecount, srec_visitor visit, void *ctx) {
+	const char *s = text;
+	const char *end = text + len;
+	const char *eol, *last;
+	struct srec rec;
+	int rc;
 
-	int len;
-	int linecount = 0;
-	char *s;
-	struct srec *tail = NULL;
-	struct srec *nextitem = NULL;
-	struct srec item;
-	while (fgets(line, sizeof(line) - 1, F)) {
-		linecount++;
-
-		s = str_trim(line);
-		len = strlen(s);
-		if (len < 10) {
-			LOGE("Line %d in '%s' is not a valid S-Record.", linecount, filepath);
-			continue;
+	while (s < end) {
+		eol = memchr(s, '\n', end - s);
+		if (eol == NULL) eol = end;
+
+		(*linecount)++;
+
+		//Trim both ends in place.
+		last = eol;
+		while (s < last && isspace((uint8_t)*s)) s++;
+		while (last > s && isspace((uint8_t)last[-1])) last--;
+
+		if (last > s) {
+			rc = srec_parse(s, last, &rec);
+			if (rc != E_NONE) {
+				return rc;
+			}
+
+			rc = visit(&rec, ctx);
+			if (rc != E_NONE) {
+				return rc;
+			}
 		}
 
-		memset(&item, 0x00, sizeof(struct srec));
+		s = eol + 1;
+	}
 
-		s = srec_parse_header(s, &item);
-		if (s == NULL) {
-			LOGE("Line %d in '%s' is not a valid S-Record, malformed header.", linecount, filepath);
-			continue;
+	return E_NONE;
+}
+
+/**
+	Log a parse error from srec_scanlines().
+	@param rc Return value of srec_scanlines().
+	@param line The line it stopped at.
+	@param path Name of the source.
+	@return Returns E_ERROR for parse errors, otherwise rc.
+*/
+static int srec_scanerror(int rc, int line, const char *path) {
+	if (rc == E_CRC) {
+		LOGE("Line %d in '%s' has invalid checksum.", line, path);
+		return E_ERROR;
+	} else if (rc == E_MSGMALFORMED) {
+		LOGE("Line %d in '%s' is not a valid S-Record.", line, path);
+		return E_ERROR;
+	}
+	return rc;
+}
+
+#ifndef __WIN32__
+
+/** Smallest piece of text worth giving to a thread of its own. */
+#define SREC_CHUNK_MIN (1024 * 1024)
+
+/** Upper limit on parser threads. */
+#define SREC_THREADS_MAX 8
+
+/**
+	One line aligned piece of a file, parsed by its own thread.
+	Records are packed back to back as type, count, 32 bit address and count bytes of data,
+	then handed to the visitor in file order once every thread is done.
+*/
+struct srec_chunk {
+	const char *text;		/**< First character of the chunk. */
+	size_t len;				/**< Number of characters in text[]. */
+	int lines;				/**< Lines scanned, the failing line on error. */
+	int rc;					/**< Result of srec_scanlines(). */
+	uint8_t *packed;		/**< Parsed records. */
+	size_t used;			/**< Bytes used in packed[]. */
+	size_t size;			/**< Bytes allocated for packed[]. */
+};
+
+/** Append a record to the chunk in ctx. */
+static int srec_visitpack(struct srec *rec, void *ctx) {
+	struct srec_chunk *chunk = (struct srec_chunk *)ctx;
+	size_t need = 2 + sizeof(uint32_t) + rec->count;
+
+	if (chunk->used + need > chunk->size) {
+		chunk->size = (chunk->size + need) * 2;
+		chunk->packed = realloc(chunk->packed, chunk->size);
+		assert(chunk->packed);
+	}
+
+	uint8_t *p = chunk->packed + chunk->used;
+	p[0] = rec->type;
+	p[1] = rec->count;
+	memcpy(p + 2, &rec->address, sizeof(uint32_t));
+	memcpy(p + 2 + sizeof(uint32_t), rec->data, rec->count);
+	chunk->used += need;
+
+	return E_NONE;
+}
+
+/** Thread entry, parse one chunk. */
+static void *srec_parsechunk(void *arg) {
+	struct srec_chunk *chunk = (struct srec_chunk *)arg;
+	chunk->rc = srec_scanlines(chunk->text, chunk->len, &chunk->lines, srec_visitpack, chunk);
+	return NULL;
+}
+
+/**
+	Scan text on several threads.
+	Only parsing is parallel. Records reach the visitor in file order and the first error in file order
+	is the one reported, so the outcome does not depend on thread timing.
+	Placement stays serial on purpose: which record of an overlap or mismatch is reported, and the
+	noverlap count, follow file order, and placing a full 1 MiB image takes about 4 ms against about
+	8 ms of parsing, well below the time to erase and program it.
+	@param text The text.
+	@param len Number of characters in text[].
+	@param nchunks Number of threads, at most SREC_THREADS_MAX.
+	@param path Name of the source for error messages.
+	@param visit Callback for every record.
+	@param ctx Passed to visit.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int srec_scanparallel(const char *text, size_t len, int nchunks, const char *path, srec_visitor visit, void *ctx) {
+	struct srec_chunk chunks[SREC_THREADS_MAX];
+	pthread_t threads[SREC_THREADS_MAX];
+	bool started[SREC_THREADS_MAX];
+	const char *s = text;
+	const char *end = text + len;
+	struct srec rec;
+	int line = 0;
+	int rc = E_NONE;
+	int i;
+
+	//Cut at the first newline after every even split.
+	memset(chunks, 0x00, sizeof(chunks));
+	for (i = 0; i < nchunks; i++) {
+		const char *cut = (i == nchunks - 1) ? end : text + len / nchunks * (i + 1);
+		if (cut < s) cut = s;
+		const char *eol = memchr(cut, '\n', end - cut);
+		cut = eol ? eol + 1 : end;
+
+		chunks[i].text = s;
+		chunks[i].len = cut - s;
+		chunks[i].size = chunks[i].len / 2;
+		chunks[i].packed = malloc(chunks[i].size + 1);
+		assert(chunks[i].packed);
+		s = cut;
+
+		started[i] = (pthread_create(&threads[i], NULL, srec_parsechunk, &chunks[i]) == 0);
+		if (!started[i]) {
+			srec_parsechunk(&chunks[i]);
 		}
+	}
 
-		s = srec_parse_count(s, &item);
-		if (s == NULL) {
-			LOGE("Line %d in '%s' is not a valid S-Record, invalid count.", linecount, filepath);
-			continue;
+	for (i = 0; i < nchunks; i++) {
+		if (started[i]) pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < nchunks && rc == E_NONE; i++) {
+		const uint8_t *p = chunks[i].packed;
+		const uint8_t *pend = p + chunks[i].used;
+
+		//Records before a failure in this chunk are still visited, in order.
+		while (rc == E_NONE && p < pend) {
+			rec.type = p[0];
+			rec.count = p[1];
+			memcpy(&rec.address, p + 2, sizeof(uint32_t));
+			memcpy(rec.data, p + 2 + sizeof(uint32_t), rec.count);
+			rec.next = NULL;
+			p += 2 + sizeof(uint32_t) + rec.count;
+
+			rc = visit(&rec, ctx);
 		}
 
-		s = srec_parse_address(s, &item);
-		if (s == NULL) {
-			LOGE("Line %d in '%s' is not a valid S-Record, invalid address.", linecount, filepath);
-			continue;
+		if (rc == E_NONE && chunks[i].rc != E_NONE) {
+			rc = srec_scanerror(chunks[i].rc, line + chunks[i].lines, path);
 		}
+		line += chunks[i].lines;
+	}
+
+	for (i = 0; i < nchunks; i++) {
+		free(chunks[i].packed);
+	}
+
+	return rc;
+}
+
+#endif //__WIN32__
 
-		s = srec_parse_data(s, &item);
-		if (s == NULL) {
-			LOGE("Line %d in '%s' is not a valid S-Record, invalid data.", linecount, filepath);
+/**
+	Scan text that is all in memory, on several threads when it is large.
+	@param text The text.
+	@param len Number of characters in text[].
+	@param path Name of the source for error messages.
+	@param visit Callback for every record.
+	@param ctx Passed to visit.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int srec_scantext(const char *text, size_t len, const char *path, srec_visitor visit, void *ctx) {
+	int linecount = 0;
+	int rc;
+
+#ifndef __WIN32__
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nchunks = len / SREC_CHUNK_MIN;
+	if (nthreads > SREC_THREADS_MAX) nthreads = SREC_THREADS_MAX;
+	if (nchunks > (size_t)nthreads) nchunks = nthreads;
+	if (nchunks > 1) {
+		return srec_scanparallel(text, len, nchunks, path, visit, ctx);
+	}
+#endif
+
+	rc = srec_scanlines(text, len, &linecount, visit, ctx);
+	return srec_scanerror(rc, linecount, path);
+}
+
+/**
+	Scan S-Records from a stream such as a pipe that can not be mapped.
+	@param F The stream.
+	@param path Name of the source for error messages.
+	@param visit Callback for every record.
+	@param ctx Passed to visit.
+	@return On success, returns E_NONE.
+	@return On failure, returns a negative error code.
+*/
+static int srec_scanstream(FILE *F, const char *path, srec_visitor visit, void *ctx) {
+	const size_t size = 64 * 1024;
+	size_t used = 0;
+	size_t n;
+	int linecount = 0;
+	int rc = E_NONE;
+
+	char *chunk = malloc(size);
+	assert(chunk);
+
+	while ((n = fread(chunk + used, 1, size - used, F)) > 0) {
+		used += n;
+
+		//Scan whole lines only, the rest waits for the next read.
+		char *last = chunk + used;
+		while (last > chunk && last[-1] != '\n') last--;
+
+		if (last == chunk) {
+			if (used == size) {
+				LOGE("Line %d in '%s' is too long.", linecount + 1, path);
+				rc = E_SIZE;
+				break;
+			}
 			continue;
 		}
 
-		s = srec_parse_checksum(s, &item);
-		if (s == NULL) {
-			LOGE("Line %d in '%s' is not a valid S-Record, invalid checksum.", linecount, filepath);
-			continue;
+		rc = srec_scanlines(chunk, last - chunk, &linecount, visit, ctx);
+		if (rc != E_NONE) {
+			rc = srec_scanerror(rc, linecount, path);
+			break;
 		}
 
-		//Checksum is calculated over count, address and data.
-		uint8_t csum = 0;
-		for (int n = 2; n < (int)strlen(line) - 2; n += 2) {
-			csum += fromhex2(line[n], line[n+1]);
+		used = chunk + used - last;
+		memmove(chunk, last, used);
+	}
+
+	if (rc == E_NONE && ferror(F)) {
+		LOGE("Error reading from '%s'.", path);
+		rc = E_READ;
+	}
+
+	//Last line without a newline.
+	if (rc == E_NONE && used > 0) {
+		rc = srec_scanlines(chunk, used, &linecount, visit, ctx);
+		rc = srec_scanerror(rc, linecount, path);
+	}
+
+	free(chunk);
+	return rc;
+}
+
+/** Append a copy of rec to the list in ctx, taking only the room its data needs. */
+static int srec_visitlist(struct srec *rec, void *ctx) {
+	struct srec_list *list = (struct srec_list *)ctx;
+	struct srec_arena *arena = list->arena;
+
+	//Keep records aligned for the pointer and address fields.
+	size_t size = (offsetof(struct srec, data) + rec->count + 7) & ~(size_t)7;
+
+	if (arena == NULL || arena->size - arena->used < size) {
+		arena = (struct srec_arena *)malloc(sizeof(struct srec_arena) + SREC_ARENA_CHUNK);
+		assert(arena);
+		arena->next = list->arena;
+		arena->used = 0;
+		arena->size = SREC_ARENA_CHUNK;
+		list->arena = arena;
+	}
+
+	struct srec *item = (struct srec *)(arena->mem + arena->used);
+	arena->used += size;
+	memcpy(item, rec, offsetof(struct srec, data) + rec->count);
+	item->next = NULL;
+
+	if (list->head == NULL) {
+		list->head = item;
+	} else {
+		list->tail->next = item;
+	}
+	list->tail = item;
+	list->count++;
+
+	return E_NONE;
+}
+
+/** Context for srec_readimage(). */
+struct srec_imagectx {
+	struct image *image;	/**< The image being filled. */
+	const char *path;		/**< Source file for error messages. */
+	uint32_t address_low;	/**< Lower bound for address check. */
+	uint32_t address_high;	/**< Upper bound for address check. */
+};
+
+/** Copy S1, S2 and S3 data records into the image in ctx. */
+static int srec_visitimage(struct srec *rec, void *ctx) {
+	struct srec_imagectx *img = (struct srec_imagectx *)ctx;
+
+	if (rec->type < 1 || rec->type > 3 || rec->count == 0) {
+		return E_NONE;
+	}
+
+	if (rec->address < img->address_low || rec->address + rec->count - 1 > img->address_high) {
+		LOGE("S-Record in '%s' has out of bounds data. Address 0x%06X is outside of (0x%06X - 0x%06X).", img->path, rec->address, img->address_low, img->address_high);
+		return E_RANGE;
+	}
+
+	int rc = image_write(img->image, rec->address, rec->data, rec->count);
+	if (rc == E_MISMATCH) {
+		LOGE("S-Record at 0x%06X in '%s' overwrites earlier data with different values.", rec->address, img->path);
+	}
+
+	return rc;
+}
+
+/**************************************************** Public *****************************************************/
+
+int srec_scanfile(const char *path, srec_visitor visit, void *ctx) {
+	int rc;
+
+	//Standard input can only be streamed.
+	if (strcmp(path, "-") == 0) {
+		return srec_scanstream(stdin, path, visit, ctx);
+	}
+
+#ifdef __WIN32__
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		LOGE("ERROR: Could not open file '%s' for reading.", path);
+		return E_OPEN;
+	}
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	const char *text = NULL;
+	if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			text = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
 		}
-		csum = (~csum);
+	}
 
-		if (csum != item.csum) {
-			LOGE("Line %d in '%s' has invalid checksum (0x%02X != 0x%02X)", linecount, filepath, csum, item.csum);
-			return E_ERROR;
+	if (text) {
+		rc = srec_scantext(text, (size_t)size.QuadPart, path, visit, ctx);
+		UnmapViewOfFile(text);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return rc;
+	}
+
+	if (mapping) CloseHandle(mapping);
+	CloseHandle(file);
+
+	//Not something we can map, read it as a stream.
+	FILE *F = fopen(path, "rb");
+	if (F == NULL) {
+		LOGE("ERROR: Could not open file '%s' for reading.", path);
+		return E_OPEN;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		LOGE("ERROR: Could not open file '%s' for reading.", path);
+		return E_OPEN;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size == 0) {
+			close(fd);
+			return E_NONE;
 		}
 
-		//Only add valid records to list.
-		nextitem = (struct srec *)calloc(1, sizeof(struct srec));
-		assert(nextitem);
-		memcpy(nextitem, &item, sizeof(struct srec));
-
-		if (*reclist == NULL) {
-			*reclist = nextitem;
-			tail = *reclist;
-		} else {
-			tail->next = nextitem;
-			tail = nextitem;
+		const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (text != MAP_FAILED) {
+			madvise((void *)text, st.st_size, MADV_SEQUENTIAL);
+			rc = srec_scantext(text, st.st_size, path, visit, ctx);
+			munmap((void *)text, st.st_size);
+			close(fd);
+			return rc;
 		}
 	}
 
+	//Pipes, devices and anything else we can not map.
+	FILE *F = fdopen(fd, "rb");
+	if (F == NULL) {
+		close(fd);
+		return E_OPEN;
+	}
+#endif
+
+	rc = srec_scanstream(F, path, visit, ctx);
 	fclose(F);
-	F = NULL;
+	return rc;
+}
 
-	return E_NONE;
+int srec_readfile(struct srec_list **reclist, const char *filepath) {
+	*reclist = (struct srec_list *)calloc(1, sizeof(struct srec_list));
+	assert(*reclist);
+
+	int rc = srec_scanfile(filepath, srec_visitlist, *reclist);
+	if (rc != E_NONE) {
+		srec_freelist(reclist);
+	}
+
+	return rc;
 }
 
-int srec_printlist(struct srec *reclist) {
+int srec_printlist(struct srec_list *reclist) {
 	assert(reclist);
 
-	for (struct srec *sr = reclist; sr; sr = sr->next) {
+	for (struct srec *sr = reclist->head; sr; sr = sr->next) {
 		//Header, count and address.
 		switch (sr->type) {
 			case 0: printf("S0%02X%04X", sr->count + 3, sr->address); break;
@@ -275,6 +660,7 @@ int srec_printlist(struct srec *reclist) {
 			case 2: printf("S2%02X%06X", sr->count + 4, sr->address); break;
 			case 3: printf("S3%02X%08X", sr->count + 5, sr->address); break;
 			case 5: printf("S5%02X%04X", sr->count + 3, sr->address); break;
+			case 6: printf("S6%02X%06X", sr->count + 4, sr->address); break;
 			case 7: printf("S7%02X%08X", sr->count + 5, sr->address); break;
 			case 8: printf("S8%02X%06X", sr->count + 4, sr->address); break;
 			case 9: printf("S9%02X%04X", sr->count + 3, sr->address); break;
@@ -290,182 +676,462 @@ int srec_printlist(struct srec *reclist) {
 	return E_NONE;
 }
 
-void srec_freelist(struct srec **reclist) {
-	struct srec *item, *next;
+void srec_freelist(struct srec_list **reclist) {
+	struct srec_arena *arena, *next;
 	if (reclist && *reclist) {
-		item = *reclist;
-		while (item) {
-			next = item->next;
-			free(item);
-			item = next;
+		for (arena = (*reclist)->arena; arena; arena = next) {
+			next = arena->next;
+			free(arena);
 		}
+		free(*reclist);
 		*reclist = NULL;
 	}
 }
 
-int srec_readfilebin(uint8_t **buf, const char *path, uint32_t address_low, uint32_t address_high) {
-	char line[600];	//Enough for full S8 record.
-	char *s;
-	int len;
+int srec_readimage(struct image **image, const char *path, uint32_t address_low, uint32_t address_high) {
+	int rc = image_new(image, address_low, address_high);
+	if (rc != E_NONE) {
+		return rc;
+	}
 
-	FILE *F = fopen(path, "rb");
-	if (F == NULL) {
-		return E_OPEN;
+	struct srec_imagectx img = { .image = *image, .path = path, .address_low = address_low, .address_high = address_high };
+
+	rc = srec_scanfile(path, srec_visitimage, &img);
+	if (rc != E_NONE) {
+		image_free(image);
+		return rc;
 	}
 
-	//Allocate for full flash, it's only 16 megabytes.
-	uint32_t size = 0xFFFFFF + 1;
+	if ((*image)->noverlap > 0) {
+		LOGW("%u bytes in '%s' are given more than once, with the same values.", (*image)->noverlap, path);
+	}
 
-	*buf = calloc(1, size);
-	assert(*buf);
+	image_seal(*image);
+	return E_NONE;
+}
 
-	memset(*buf, 0xFF, size);
-	memset(line, 0x00, sizeof(line));
+int srec_listimage(struct image **image, struct srec_list *reclist, const char *path, uint32_t address_low, uint32_t address_high) {
+	int rc = image_new(image, address_low, address_high);
+	if (rc != E_NONE) {
+		return rc;
+	}
 
-	struct srec rec;
+	struct srec_imagectx img = { .image = *image, .path = path, .address_low = address_low, .address_high = address_high };
 
-	while (fgets(line, sizeof(line) - 1, F)) {
-		s = str_trim(line);
-		len = strlen(s);
-		if (len < 10) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record.", line, path);
-			continue;
+	for (struct srec *sr = reclist->head; sr; sr = sr->next) {
+		rc = srec_visitimage(sr, &img);
+		if (rc != E_NONE) {
+			image_free(image);
+			return rc;
 		}
+	}
 
-		memset(&rec, 0x00, sizeof(struct srec));
+	if ((*image)->noverlap > 0) {
+		LOGW("%u bytes in '%s' are given more than once, with the same values.", (*image)->noverlap, path);
+	}
 
-		s = srec_parse_header(s, &rec);
-		if (s == NULL) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record, malformed header.", line, path);
-			return E_ERROR;
-		}
+	image_seal(*image);
+	return E_NONE;
+}
 
-		if (rec.type != 2) {
-			//LOGD("Skipping S-Record: '%s'.", line);
-			continue;
-		}
+int srec_checkformat(const struct srec_format *format, uint32_t address_high) {
+	assert(format);
 
-		s = srec_parse_count(s, &rec);
-		if (s == NULL) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record, invalid count.", line, path);
-			return E_ERROR;
-		}
+	if (format->rectype < 1 || format->rectype > 3) {
+		LOGE("Invalid record type S%d, use S1, S2 or S3.", format->rectype);
+		return E_ARGUMENT;
+	}
 
-		s = srec_parse_address(s, &rec);
-		if (s == NULL) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record, invalid address.", line, path);
-			return E_ERROR;
-		}
+	if (format->length < 1 || format->length > SREC_LENGTH_MAX) {
+		LOGE("Invalid record length %d, use 1 - %d bytes.", format->length, SREC_LENGTH_MAX);
+		return E_ARGUMENT;
+	}
 
-		if (rec.address < address_low || rec.address > address_high) {
-			LOGE("Line '%s' in '%s' has out of bounds data. Address 0x%06X is outside of (0x%06X - 0x%06X", line, path, rec.address, address_low, address_high);
-			return E_RANGE;
-		}
+	//S1 has 16 bit and S2 24 bit addresses.
+	if (format->rectype < 3 && (address_high >> (8 * (format->rectype + 1))) != 0) {
+		LOGE("Address 0x%08X does not fit in S%d records.", address_high, format->rectype);
+		return E_RANGE;
+	}
 
-		s = srec_parse_data(s, &rec);
-		if (s == NULL) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record, invalid data.", line, path);
-			return E_ERROR;
-		}
+	return E_NONE;
+}
 
-		s = srec_parse_checksum(s, &rec);
-		if (s == NULL) {
-			LOGE("Line '%s' in '%s' is not a valid S-Record, invalid checksum.", line, path);
-			continue;
-		}
+/** Longest record line: type, count, 4 address bytes, data, checksum and newline. */
+#define SREC_LINE_MAX (2 + 2 * (1 + 4 + SREC_LENGTH_MAX + 1) + 1)
 
-		//Checksum is calculated over count, address and data.
-		uint8_t csum = 0;
-		for (int n = 2; n < (int)strlen(line) - 2; n += 2) {
-			csum += fromhex2(line[n], line[n+1]);
-		}
-		csum = (~csum);
+/**
+	Encode one record straight from binary data, checksum included.
+	@param p Destination, room for SREC_LINE_MAX characters.
+	@param type Record type.
+	@param alen Number of address bytes.
+	@param address Address field.
+	@param data Data bytes.
+	@param len Number of bytes in data[].
+	@return Returns a pointer past the newline.
+*/
+static char *srec_encodeline(char *p, uint8_t type, int alen, uint32_t address, const uint8_t *data, uint32_t len) {
+	uint8_t head[5];
+	uint8_t sum = 0;
+	uint32_t i;
+
+	//Count covers address, data and checksum.
+	head[0] = alen + len + 1;
+	for (i = 0; i < (uint32_t)alen; i++) {
+		head[1 + i] = address >> (8 * (alen - 1 - i));
+	}
+
+	for (i = 0; i < (uint32_t)alen + 1; i++) sum += head[i];
+	for (i = 0; i < len; i++) sum += data[i];
+	sum = (~sum);
+
+	p[0] = 'S';
+	p[1] = '0' + type;
+	hex_encode(p + 2, head, alen + 1);
+	p += 2 + (alen + 1) * 2;
+	hex_encode(p, data, len);
+	p += len * 2;
+	hex_encode(p, &sum, 1);
+	p[2] = '\n';
+
+	return p + 3;
+}
 
-		if (csum != rec.csum) {
-			LOGE("Line '%s' in '%s' has invalid checksum (0x%02X != 0x%02X)", line, path, csum, rec.csum);
-			return E_ERROR;
+/**
+	Print the data records for a buffer, leaving out erased flash.
+	Records are aligned to multiples of format->length. Within a record the leading and
+	trailing 0xFF are dropped and a run of 0xFF that costs more to write out than a new
+	record header splits it in two.
+	Records go through a local buffer that is written with one fwrite() per few kilobytes.
+	@param buf The binary buffer.
+	@param size How many bytes in buffer[].
+	@param format Output format.
+	@param address The base address of the buffer.
+	@param F Destination.
+	@param final If false, a record cut short by the end of buf[] is left for the next call.
+	@param pcount Incremented by the number of records written.
+	@return Returns the number of bytes of buf[] done with.
+*/
+static size_t srec_printrecords(const uint8_t *buf, size_t size, const struct srec_format *format, uint32_t address, FILE *F, bool final, uint32_t *pcount) {
+	char out[16 * SREC_LINE_MAX];
+	int alen = format->rectype + 1;
+	//2 characters per 0xFF byte against the type, count, address, checksum and newline of another record.
+	uint32_t gap = alen + 4;
+	size_t n = 0;
+	size_t pos, end, i, first, last;
+	uint32_t run;
+
+	for (pos = 0; pos < size; pos = end) {
+		//Erased flash up to the next data is left out altogether.
+		pos += blank_span(buf + pos, size - pos);
+		if (pos == size) break;
+
+		end = pos + format->length - (address + pos) % format->length;
+		if (end > size) {
+			if (!final) break;
+			end = size;
 		}
 
-		//If all checks out, copy only type 2 data records into buffer.
-		//LOGD("Processing data record %d for address 0x%06X, %d bytes.", rec.type, rec.address, rec.count);
-		for (uint8_t i = 0; i < rec.count; i++) {
-			(*buf)[rec.address + i] = rec.data[i];
+		for (i = pos; i < end; i = last) {
+			i += blank_span(buf + i, end - i);
+			if (i == end) break;
+
+			first = i;
+			last = i + 1;
+			run = 0;
+			for (i++; i < end; i++) {
+				if (buf[i] != 0xFF) {
+					last = i + 1;
+					run = 0;
+				} else if (++run == gap) {
+					break;
+				}
+			}
+
+			n = srec_encodeline(out + n, format->rectype, alen, address + first, buf + first, last - first) - out;
+			(*pcount)++;
+
+			if (sizeof(out) - n < SREC_LINE_MAX) {
+				fwrite(out, 1, n, F);
+				n = 0;
+			}
 		}
 	}
 
-	return E_NONE;
+	if (n > 0) {
+		fwrite(out, 1, n, F);
+	}
+
+	return pos;
 }
 
-int srec_printbuffer(uint8_t *buf, size_t size, uint8_t rectype, uint32_t address, FILE *F) {
-	uint32_t bl;
-	int n;
-	int i;
-	uint8_t csum;
-	char out[256];
-	bool empty;
+/**
+	Print the record count and termination record.
+	@param format Output format.
+	@param count Number of data records written.
+	@param F Destination.
+*/
+static void srec_printend(const struct srec_format *format, uint32_t count, FILE *F) {
+	char out[2 * SREC_LINE_MAX];
+	char *p = out;
+
+	//S5 counts up to 0xFFFF records, S6 up to 0xFFFFFF.
+	if (count <= 0xFFFF) {
+		p = srec_encodeline(p, 5, 2, count, NULL, 0);
+	} else {
+		p = srec_encodeline(p, 6, 3, count & 0xFFFFFF, NULL, 0);
+	}
+
+	//S9 ends S1, S8 ends S2 and S7 ends S3. There is no entry point.
+	p = srec_encodeline(p, 10 - format->rectype, format->rectype + 1, 0, NULL, 0);
+
+	fwrite(out, 1, p - out, F);
+}
+
+int srec_printbuffer(uint8_t *buf, size_t size, const struct srec_format *format, uint32_t address, FILE *F) {
+	uint32_t count = 0;
 
 	if (F == NULL) F = stdout;
 
 	assert(buf);
 
-	if (rectype != 1 && rectype != 2 && rectype != 3) {
-		LOGE("Invalid record type %d.", rectype);
-		return E_ARGUMENT;
+	int rc = srec_checkformat(format, size > 0 ? address + (size - 1) : address);
+	if (rc != E_NONE) {
+		return rc;
 	}
 
 	fprintf(F, "S00700004B756A6965\n");
+	srec_printrecords(buf, size, format, address, F, true, &count);
 
-	for (bl = 0; bl < size; bl += 16) {
-		memset(out, 0x00, sizeof(out));
-		n = 0;
+	if (format->terminate) {
+		srec_printend(format, count, F);
+	}
 
-		//Header, count and address.
-		switch (rectype) {
-			case 1: n += snprintf(out + n, sizeof(out) - n, "S114%04X", address + bl); break;
-			case 2: n += snprintf(out + n, sizeof(out) - n, "S214%06X", address + bl); break;
-			case 3: n += snprintf(out + n, sizeof(out) - n, "S214%08X", address + bl); break;
-		}
+	return E_NONE;
+}
 
-		empty = true;
-		for (i = 0; i < 16; i++) {
-			n += snprintf(out + n, sizeof(out) - n, "%02X", buf[bl + i]);
-			if (buf[bl + i] != 0xFF) empty = false;
-		}
+int srec_writefilebin(uint8_t *buf, size_t size, const char *path, const struct srec_format *format, uint32_t address) {
+	FILE *F = fopen(path, "w+");
+
+	if (F == NULL) {
+		LOGE("Could not open file '%s' for writing.", path);
+		return E_OPEN;
+	}
+	setvbuf(F, NULL, _IOFBF, SREC_WRITER_BUFFER);
+
+	int rc = srec_printbuffer(buf, size, format, address, F);
+	if (rc == E_NONE && ferror(F)) rc = E_WRITE;
+	if (fclose(F) != 0 && rc == E_NONE) rc = E_WRITE;
+
+	if (rc != E_NONE) {
+		LOGE("Error writing to file '%s'.", path);
+	}
 
-		if (empty) continue;
+	return rc;
+}
 
-		//Checksum is calculated over count, address and data.
-		csum = 0;
-		for (i = 2; i < (int)strlen(out); i += 2) {
-			csum += fromhex2(out[i], out[i+1]);
+/**
+	Write out all staged data of a writer.
+	@param w The writer.
+*/
+static void srec_writer_flush(struct srec_writer *w) {
+	srec_printrecords(w->stage, w->staged, &w->format, w->stageaddr, w->F, true, &w->nrecords);
+	w->stageaddr += w->staged;
+	w->staged = 0;
+}
+
+/**
+	Encode a block of a writer. Whatever does not make a whole record stays staged
+	until the next block, as long as that block follows on.
+	@param w The writer.
+	@param address Address of buf[0].
+	@param buf The data.
+	@param size Number of bytes in buf[], at most SREC_WRITER_BLOCK.
+*/
+static void srec_writer_encode(struct srec_writer *w, uint32_t address, const uint8_t *buf, uint32_t size) {
+	size_t done;
+
+	if (w->staged > 0 && w->stageaddr + w->staged != address) {
+		srec_writer_flush(w);
+	}
+	if (w->staged == 0) {
+		w->stageaddr = address;
+	}
+
+	memcpy(w->stage + w->staged, buf, size);
+	w->staged += size;
+
+	done = srec_printrecords(w->stage, w->staged, &w->format, w->stageaddr, w->F, false, &w->nrecords);
+	memmove(w->stage, w->stage + done, w->staged - done);
+	w->staged -= done;
+	w->stageaddr += done;
+}
+
+#ifndef __WIN32__
+/**
+	Encoder thread of a writer. Turns queued blocks into records until the writer is closed and the queue is empty.
+	@param arg The writer.
+	@return Returns NULL.
+*/
+static void *srec_writer_run(void *arg) {
+	struct srec_writer *w = (struct srec_writer *)arg;
+	struct srec_writerslot *slot;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (w->head == w->tail && !w->closing) {
+			pthread_cond_wait(&w->ready, &w->lock);
+		}
+		if (w->head == w->tail) {
+			break;
 		}
-		csum = (~csum);
 
-		n += snprintf(out + n, sizeof(out) - n, "%02X", csum);
-		out[n] = '\0';
+		//The slot stays ours until tail moves past it.
+		slot = &w->slots[w->tail % SREC_WRITER_SLOTS];
+		pthread_mutex_unlock(&w->lock);
 
-		fprintf(F, "%s\n", out);
+		srec_writer_encode(w, slot->address, slot->data, slot->size);
+
+		pthread_mutex_lock(&w->lock);
+		if (ferror(w->F) && w->rc == E_NONE) {
+			w->rc = E_WRITE;
+		}
+		w->tail++;
+		pthread_cond_signal(&w->space);
 	}
+	pthread_mutex_unlock(&w->lock);
 
-	return E_NONE;
+	return NULL;
 }
+#endif
 
-int srec_writefilebin(uint8_t *buf, size_t size, const char *path, uint8_t rectype, uint32_t address) {
-	FILE *F = fopen(path, "w+");
+int srec_writer_new(struct srec_writer **w, const char *path, const struct srec_format *format) {
+	assert(w);
+	assert(format);
 
-	if (F == NULL) {
+	*w = NULL;
+
+	//The range is checked by the caller, who knows it.
+	int rc = srec_checkformat(format, 0);
+	if (rc != E_NONE) {
+		return rc;
+	}
+
+	struct srec_writer *wr = (struct srec_writer *)calloc(1, sizeof(struct srec_writer));
+	assert(wr);
+
+	wr->F = fopen(path, "w+");
+	if (wr->F == NULL) {
 		LOGE("Could not open file '%s' for writing.", path);
+		free(wr);
 		return E_OPEN;
 	}
 
-	int rc = srec_printbuffer(buf, size, rectype, address, F);
-	fclose(F);
+	snprintf(wr->path, sizeof(wr->path), "%s", path);
+	wr->format = *format;
+	setvbuf(wr->F, NULL, _IOFBF, SREC_WRITER_BUFFER);
+	fprintf(wr->F, "S00700004B756A6965\n");
+
+#ifndef __WIN32__
+	pthread_mutex_init(&wr->lock, NULL);
+	pthread_cond_init(&wr->ready, NULL);
+	pthread_cond_init(&wr->space, NULL);
+	wr->threaded = pthread_create(&wr->thread, NULL, srec_writer_run, wr) == 0;
+#endif
+
+	*w = wr;
+	return E_NONE;
+}
+
+int srec_writer_put(struct srec_writer *w, uint32_t address, const uint8_t *buf, size_t size) {
+	uint32_t chunk;
+	int rc = E_NONE;
+
+	while (rc == E_NONE && size > 0) {
+		chunk = (size > SREC_WRITER_BLOCK) ? SREC_WRITER_BLOCK : size;
+
+#ifndef __WIN32__
+		if (w->threaded) {
+			pthread_mutex_lock(&w->lock);
+			while (w->head - w->tail == SREC_WRITER_SLOTS) {
+				pthread_cond_wait(&w->space, &w->lock);
+			}
+
+			rc = w->rc;
+			if (rc == E_NONE) {
+				struct srec_writerslot *slot = &w->slots[w->head % SREC_WRITER_SLOTS];
+				slot->address = address;
+				slot->size = chunk;
+				memcpy(slot->data, buf, chunk);
+				w->head++;
+				pthread_cond_signal(&w->ready);
+			}
+			pthread_mutex_unlock(&w->lock);
+		} else
+#endif
+		{
+			srec_writer_encode(w, address, buf, chunk);
+			if (ferror(w->F)) rc = E_WRITE;
+		}
+
+		address += chunk;
+		buf += chunk;
+		size -= chunk;
+	}
 
 	if (rc != E_NONE) {
-		LOGE("Error writing to file '%s'.", path);
+		LOGE("Error writing to file '%s'.", w->path);
 	}
 
 	return rc;
 }
 
+int srec_writer_finish(struct srec_writer *w) {
+	int rc;
+
+	if (w->F == NULL) {
+		return w->rc;
+	}
+
+#ifndef __WIN32__
+	if (w->threaded) {
+		pthread_mutex_lock(&w->lock);
+		w->closing = true;
+		pthread_cond_signal(&w->ready);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->thread, NULL);
+		w->threaded = false;
+	}
+#endif
+
+	srec_writer_flush(w);
+	if (w->format.terminate) {
+		srec_printend(&w->format, w->nrecords, w->F);
+	}
+
+	rc = w->rc;
+	if (ferror(w->F)) rc = E_WRITE;
+	if (fclose(w->F) != 0) rc = E_WRITE;
+	w->F = NULL;
+
+	if (rc != E_NONE && w->rc == E_NONE) {
+		LOGE("Error writing to file '%s'.", w->path);
+	}
+	w->rc = rc;
+
+	return rc;
+}
+
+void srec_writer_free(struct srec_writer **w) {
+	if (w && *w) {
+		srec_writer_finish(*w);
+#ifndef __WIN32__
+		pthread_mutex_destroy(&(*w)->lock);
+		pthread_cond_destroy(&(*w)->ready);
+		pthread_cond_destroy(&(*w)->space);
+#endif
+		free(*w);
+		*w = NULL;
+	}
+}
+
 /** @} */
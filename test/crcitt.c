@@ -0,0 +1,101 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Self test of crcitt() and crcitt_feed() against the bit-serial definition.
+Random lengths, offsets and split points go through the table and the carry-less multiply
+paths alike, whichever this CPU takes. Run with 'make check'.
+*/
+#include "stdafx.h"
+
+/** Number of random cases. */
+#define CRCITT_CASES 20000
+
+/** Largest random buffer, long enough for several folds and a tail. */
+#define CRCITT_MAXLEN 4500
+
+/**
+	Reference CRC, one bit at a time.
+	@param crc CRC so far.
+	@param buf The buffer.
+	@param len Number of bytes in buf[].
+	@return Returns the CRC including buf[].
+*/
+static uint16_t crcitt_serial(uint16_t crc, const uint8_t *buf, size_t len) {
+	for (size_t n = 0; n < len; n++) {
+		crc ^= buf[n] << 8;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ CRCITT_POLY : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+int main(void) {
+	static uint8_t buf[CRCITT_MAXLEN + 16];
+	size_t off, len, a, b;
+	uint16_t want, got;
+	int fails = 0;
+
+	if (crcitt((uint8_t *)"123456789", 9) != 0x31C3) {
+		fprintf(stderr, "crcitt: check value 0x%04X, expected 0x31C3\n", crcitt((uint8_t *)"123456789", 9));
+		fails++;
+	}
+
+	srand(1);
+	for (int t = 0; t < CRCITT_CASES; t++) {
+		for (size_t i = 0; i < sizeof(buf); i++) buf[i] = rand();
+
+		//Every length up to a few folds, then random ones.
+		len = (t < 300) ? (size_t)t : (size_t)rand() % (CRCITT_MAXLEN + 1);
+		off = rand() % 16;
+		a = len ? rand() % (len + 1) : 0;
+		b = a + ((len - a) ? rand() % (len - a + 1) : 0);
+
+		want = crcitt_serial(0, buf + off, len);
+
+		got = crcitt(buf + off, len);
+		if (got != want) {
+			fprintf(stderr, "crcitt: length %zu at offset %zu gives 0x%04X, expected 0x%04X\n", len, off, got, want);
+			fails++;
+		}
+
+		got = crcitt_feed(crcitt_feed(crcitt_feed(0, buf + off, a), buf + off + a, b - a), buf + off + b, len - b);
+		if (got != want) {
+			fprintf(stderr, "crcitt_feed: length %zu at offset %zu split at %zu and %zu gives 0x%04X, expected 0x%04X\n", len, off, a, b, got, want);
+			fails++;
+		}
+
+		//A running CRC must fold in the same as one started from zero.
+		got = crcitt_feed(want, buf, a);
+		if (got != crcitt_serial(want, buf, a)) {
+			fprintf(stderr, "crcitt_feed: length %zu from 0x%04X gives 0x%04X\n", a, want, got);
+			fails++;
+		}
+
+		if (fails > 10) break;
+	}
+
+	if (fails) {
+		fprintf(stderr, "crcitt: FAILED\n");
+		return 1;
+	}
+
+	printf("crcitt: %d cases passed\n", CRCITT_CASES);
+	return 0;
+}
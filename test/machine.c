@@ -0,0 +1,321 @@
+/*
+Kuji32 Flash MCU Programmer
+Copyright (C) 2014 Kari Sigurjonsson
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Loopback test of the non-blocking kernal32 and birom32 state machines.
+Each case replays the byte exchange of one command the way the blocking functions see it on the wire,
+once with the bytes in one piece and once a byte at a time, and checks what the machine sends and returns.
+Run with 'make check'.
+*/
+#include "stdafx.h"
+
+/** Largest number of steps in one exchange. */
+#define EXCHANGE_MAX 8
+
+/** One step of a recorded exchange. */
+struct exchange {
+	char dir;				/**< '>' for bytes the PC sends, '<' for bytes the MCU sends, '.' for a pause. */
+	const uint8_t *bytes;	/**< The bytes. */
+	uint32_t len;			/**< Number of bytes in bytes[]. */
+	double wait;			/**< Length of a pause in seconds. */
+};
+
+/** A state machine under test, either kernal32 or birom32. */
+struct machine {
+	void *m;												/**< The machine. */
+	int (*step)(void *m, const uint8_t *rx, int rxlen, double now);	/**< Advance it. */
+	void (*sent)(void *m, int n);							/**< Tell it bytes went out. */
+	const uint8_t *(*pending)(void *m, int *len);			/**< Bytes it wants sent. */
+};
+
+/** struct machine step for kernal32. */
+static int kstep(void *m, const uint8_t *rx, int rxlen, double now) {
+	return kernal32_step((struct kernal32_machine *)m, rx, rxlen, now);
+}
+
+/** struct machine sent for kernal32. */
+static void ksent(void *m, int n) {
+	kernal32_sent((struct kernal32_machine *)m, n);
+}
+
+/** struct machine pending for kernal32. */
+static const uint8_t *kpending(void *m, int *len) {
+	*len = ((struct kernal32_machine *)m)->txlen;
+	return ((struct kernal32_machine *)m)->tx;
+}
+
+/** struct machine step for birom32. */
+static int bstep(void *m, const uint8_t *rx, int rxlen, double now) {
+	return birom32_step((struct birom32_machine *)m, rx, rxlen, now);
+}
+
+/** struct machine sent for birom32. */
+static void bsent(void *m, int n) {
+	birom32_sent((struct birom32_machine *)m, n);
+}
+
+/** struct machine pending for birom32. */
+static const uint8_t *bpending(void *m, int *len) {
+	*len = ((struct birom32_machine *)m)->txlen;
+	return ((struct birom32_machine *)m)->tx;
+}
+
+/** Number of failed cases. */
+static int fails;
+
+/**
+	Replay an exchange through a machine that has been started at time 0.
+	@param name Name of the case for messages.
+	@param mc The machine.
+	@param x The exchange.
+	@param nx Number of steps in x[].
+	@param piece Largest number of bytes to send or receive at once.
+	@return Returns what the machine returns once the exchange is over, or E_MISMATCH if it sent something else.
+*/
+static int replay(const char *name, struct machine *mc, const struct exchange *x, int nx, int piece) {
+	const uint8_t *tx;
+	double now = 0;
+	uint32_t off, k;
+	int txlen, rc;
+
+	for (int i = 0; i < nx; i++, now += 0.001) {
+		for (off = 0; off < x[i].len; off += k) {
+			k = x[i].len - off;
+			if (k > (uint32_t)piece) k = piece;
+
+			if (x[i].dir == '<') {
+				rc = mc->step(mc->m, x[i].bytes + off, k, now);
+				if (rc != E_WOULDBLOCK && off + k < x[i].len) {
+					fprintf(stderr, "%s: step %d finished with %d before byte %u\n", name, i, rc, off + k);
+					return E_MISMATCH;
+				}
+				continue;
+			}
+
+			rc = mc->step(mc->m, NULL, 0, now);
+			if (rc != E_WOULDBLOCK) {
+				fprintf(stderr, "%s: step %d finished with %d before sending byte %u\n", name, i, rc, off);
+				return E_MISMATCH;
+			}
+
+			tx = mc->pending(mc->m, &txlen);
+			if (txlen < 1) {
+				fprintf(stderr, "%s: step %d has nothing to send at byte %u\n", name, i, off);
+				return E_MISMATCH;
+			}
+
+			if (k > (uint32_t)txlen) k = txlen;
+			for (uint32_t j = 0; j < k; j++) {
+				if (tx[j] == x[i].bytes[off + j]) continue;
+				fprintf(stderr, "%s: step %d sends 0x%02X at byte %u, expected 0x%02X\n", name, i, tx[j], off + j, x[i].bytes[off + j]);
+				return E_MISMATCH;
+			}
+			mc->sent(mc->m, k);
+		}
+
+		if (x[i].dir == '.') now += x[i].wait;
+	}
+
+	return mc->step(mc->m, NULL, 0, now);
+}
+
+/**
+	Replay a kernal32 exchange whole and a byte at a time.
+	@param name Name of the case for messages.
+	@param cmd The command.
+	@param flash_base Flash address for the command.
+	@param buf Data block, or NULL.
+	@param size Number of bytes in buf[].
+	@param x The exchange.
+	@param nx Number of steps in x[].
+	@param want Expected result.
+*/
+static void kernal32_case(const char *name, enum kernal32_cmdid cmd, uint32_t flash_base, uint8_t *buf, uint32_t size, const struct exchange *x, int nx, int want) {
+	struct kernal32_machine m;
+	struct machine mc = { &m, kstep, ksent, kpending };
+	int pieces[2] = { 1024, 1 };
+	int rc;
+
+	for (int p = 0; p < 2; p++) {
+		memset(&m, 0x00, sizeof(m));
+		rc = kernal32_begin(&m, cmd, flash_base, buf, size, 0);
+		if (rc == E_NONE) rc = replay(name, &mc, x, nx, pieces[p]);
+		if (rc != want) {
+			fprintf(stderr, "%s: returns %d in pieces of %d, expected %d\n", name, rc, pieces[p], want);
+			fails++;
+		}
+	}
+}
+
+/**
+	Replay a birom32 exchange whole and a byte at a time.
+	@param name Name of the case for messages.
+	@param cmd The command.
+	@param address RAM address for the command.
+	@param data Data to write, or NULL.
+	@param size Number of bytes in data[].
+	@param x The exchange.
+	@param nx Number of steps in x[].
+	@param want Expected result.
+*/
+static void birom32_case(const char *name, enum birom32_cmdid cmd, uint32_t address, uint8_t *data, uint32_t size, const struct exchange *x, int nx, int want) {
+	struct birom32_machine m;
+	struct machine mc = { &m, bstep, bsent, bpending };
+	int pieces[2] = { 1024, 1 };
+	int rc;
+
+	for (int p = 0; p < 2; p++) {
+		memset(&m, 0x00, sizeof(m));
+		rc = birom32_begin(&m, cmd, address, data, size, 0);
+		if (rc == E_NONE) rc = replay(name, &mc, x, nx, pieces[p]);
+		if (rc != want) {
+			fprintf(stderr, "%s: returns %d in pieces of %d, expected %d\n", name, rc, pieces[p], want);
+			fails++;
+		}
+	}
+}
+
+/** Shorthand for a step of bytes the PC sends. */
+#define TX(b) { '>', (b), sizeof(b), 0 }
+
+/** Shorthand for a step of bytes the MCU sends. */
+#define RX(b) { '<', (b), sizeof(b), 0 }
+
+/** Shorthand for a pause. */
+#define WAIT(s) { '.', NULL, 0, (s) }
+
+int main(void) {
+	static uint8_t block[512], flash[512], readback[512];
+	uint16_t crc, csum;
+
+	verbosity = LOGG_NONE;
+
+	for (int i = 0; i < 512; i++) flash[i] = block[i] = i * 7 + 3;
+
+	/* kernal32 */
+
+	static const uint8_t intro[] = { KERNAL32_CMD_INTRO };
+	static const uint8_t ack[] = { KERNAL32_RESP_ACK };
+	static const uint8_t busyack[] = { KERNAL32_RESP_BUSY, KERNAL32_RESP_ACK };
+
+	struct exchange introok[EXCHANGE_MAX] = { TX(intro), WAIT(0.1), TX(intro), RX(ack) };
+	kernal32_case("intro", KERNAL32_CMD_INTRO, 0, NULL, 0, introok, 4, E_NONE);
+
+	struct exchange introlost[EXCHANGE_MAX] = { TX(intro), WAIT(11) };
+	kernal32_case("intro time-out", KERNAL32_CMD_INTRO, 0, NULL, 0, introlost, 2, E_TIMEOUT);
+
+	//Flash address goes out as the three low bytes, least significant first.
+	static const uint8_t blank[] = { KERNAL32_CMD_BLANKCHECK, 0x00, 0x00, 0x0C };
+	static const uint8_t notblank[] = { KERNAL32_RESP_BUSY, KERNAL32_RESP_ERRBLANK, 0x00, 0x0C, 0x02, 0x00, 0x12, 0x34, 0x56, 0x78, KERNAL32_RESP_ERRBLANK };
+	static const uint8_t badblank[] = { KERNAL32_RESP_ERRBLANK, 0x00, 0x0C, 0x02, 0x00, 0x12, 0x34, 0x56, 0x78, KERNAL32_RESP_NAK };
+
+	struct exchange blankok[EXCHANGE_MAX] = { TX(blank), RX(busyack) };
+	kernal32_case("blank check, blank", KERNAL32_CMD_BLANKCHECK, 0x0C0000, NULL, 0, blankok, 2, 1);
+
+	struct exchange blanknot[EXCHANGE_MAX] = { TX(blank), RX(notblank) };
+	kernal32_case("blank check, not blank", KERNAL32_CMD_BLANKCHECK, 0x0C0000, NULL, 0, blanknot, 2, E_NONE);
+
+	struct exchange blankbad[EXCHANGE_MAX] = { TX(blank), RX(badblank) };
+	kernal32_case("blank check, bad trailer", KERNAL32_CMD_BLANKCHECK, 0x0C0000, NULL, 0, blankbad, 2, E_MSGMALFORMED);
+
+	static const uint8_t erase[] = { KERNAL32_CMD_ERASECHIP, 0x00, 0x00, 0x08 };
+	static const uint8_t erasing[] = { KERNAL32_RESP_BUSY, KERNAL32_RESP_BUSY, KERNAL32_RESP_BUSY };
+	static const uint8_t erasenak[] = { KERNAL32_RESP_BUSY, KERNAL32_RESP_NAK };
+
+	//Each busy marker buys another 30 seconds.
+	struct exchange eraseok[EXCHANGE_MAX] = { TX(erase), RX(erasing), WAIT(25), RX(erasing), WAIT(25), RX(ack) };
+	kernal32_case("erase", KERNAL32_CMD_ERASECHIP, 0x080000, NULL, 0, eraseok, 6, E_NONE);
+
+	struct exchange erasefail[EXCHANGE_MAX] = { TX(erase), RX(erasenak) };
+	kernal32_case("erase, refused", KERNAL32_CMD_ERASECHIP, 0x080000, NULL, 0, erasefail, 2, E_FULL);
+
+	crc = crcitt(flash, sizeof(flash));
+	static const uint8_t read[] = { KERNAL32_CMD_READFLASH, 0x00, 0x04, 0x0C };
+	uint8_t readtrailer[] = { crc >> 8, crc, KERNAL32_RESP_ACK };
+	uint8_t readbadcrc[] = { crc >> 8, crc ^ 1, KERNAL32_RESP_ACK };
+
+	struct exchange readok[EXCHANGE_MAX] = { TX(read), RX(busyack), RX(flash), RX(readtrailer) };
+	kernal32_case("read", KERNAL32_CMD_READFLASH, 0x0C0400, readback, sizeof(readback), readok, 4, E_NONE);
+	if (memcmp(readback, flash, sizeof(flash))) {
+		fprintf(stderr, "read: block differs\n");
+		fails++;
+	}
+
+	struct exchange readbad[EXCHANGE_MAX] = { TX(read), RX(busyack), RX(flash), RX(readbadcrc) };
+	kernal32_case("read, bad CRC", KERNAL32_CMD_READFLASH, 0x0C0400, readback, sizeof(readback), readbad, 4, E_MSGMALFORMED);
+
+	crc = crcitt(block, sizeof(block));
+	static const uint8_t write[] = { KERNAL32_CMD_WRITEFLASH, 0x00, 0x04, 0x0C };
+	static const uint8_t writecrcerr[] = { KERNAL32_RESP_ERRCRC, KERNAL32_RESP_NAK };
+	uint8_t writecrc[] = { crc >> 8, crc };
+
+	struct exchange writeok[EXCHANGE_MAX] = { TX(write), RX(busyack), TX(block), TX(writecrc), RX(busyack) };
+	kernal32_case("write", KERNAL32_CMD_WRITEFLASH, 0x0C0400, block, sizeof(block), writeok, 5, E_NONE);
+
+	struct exchange writebad[EXCHANGE_MAX] = { TX(write), RX(busyack), TX(block), TX(writecrc), RX(writecrcerr) };
+	kernal32_case("write, CRC error", KERNAL32_CMD_WRITEFLASH, 0x0C0400, block, sizeof(block), writebad, 5, E_MSGMALFORMED);
+
+	/* birom32 */
+
+	static const uint8_t probe[] = { BIROM32_CMD_PROBE };
+	static const uint8_t probed[] = { BIROM32_RESP_PROBE };
+
+	struct exchange probeok[EXCHANGE_MAX] = { TX(probe), WAIT(0.05), TX(probe), RX(probed) };
+	birom32_case("probe", BIROM32_CMD_PROBE, 0, NULL, 0, probeok, 4, E_NONE);
+
+	struct exchange probelost[EXCHANGE_MAX] = { TX(probe), WAIT(6) };
+	birom32_case("probe time-out", BIROM32_CMD_PROBE, 0, NULL, 0, probelost, 2, E_TIMEOUT);
+
+	static const uint8_t check[] = { BIROM32_CMD_CHECK };
+	static const uint8_t checked[] = { BIROM32_RESP_CHECK };
+
+	struct exchange checkok[EXCHANGE_MAX] = { TX(check), RX(checked) };
+	birom32_case("check", BIROM32_CMD_CHECK, 0, NULL, 0, checkok, 2, E_NONE);
+
+	//RAM address and size go out least significant byte first, the checksum comes back the same way.
+	csum = checksum16(block, 300);
+	static const uint8_t bwrite[] = { BIROM32_CMD_WRITE, 0x00, 0x04, 0x08, 0x00 };
+	static const uint8_t bwriting[] = { BIROM32_RESP_WRITE };
+	static const uint8_t bsize[] = { 300 & 0xFF, 300 >> 8 };
+	uint8_t bcsum[] = { csum, csum >> 8 };
+	uint8_t bbadcsum[] = { csum ^ 1, csum >> 8 };
+
+	struct exchange bwriteok[EXCHANGE_MAX] = { TX(bwrite), RX(bwriting), TX(bsize), { '>', block, 300, 0 }, RX(bcsum) };
+	birom32_case("RAM write", BIROM32_CMD_WRITE, 0x080400, block, 300, bwriteok, 5, E_NONE);
+
+	struct exchange bwritebad[EXCHANGE_MAX] = { TX(bwrite), RX(bwriting), TX(bsize), { '>', block, 300, 0 }, RX(bbadcsum) };
+	birom32_case("RAM write, bad checksum", BIROM32_CMD_WRITE, 0x080400, block, 300, bwritebad, 5, E_CRC);
+
+	static const uint8_t call[] = { BIROM32_CMD_CALL, 0x00, 0x04, 0x08, 0x00 };
+	static const uint8_t called[] = { BIROM32_RESP_CALL, BIROM32_RESP_CALL_DONE };
+	static const uint8_t callbad[] = { BIROM32_RESP_WRITE };
+
+	struct exchange callok[EXCHANGE_MAX] = { TX(call), RX(called) };
+	birom32_case("call", BIROM32_CMD_CALL, 0x080400, NULL, 0, callok, 2, E_NONE);
+
+	struct exchange callfail[EXCHANGE_MAX] = { TX(call), RX(callbad) };
+	birom32_case("call, bad acknowledge", BIROM32_CMD_CALL, 0x080400, NULL, 0, callfail, 2, E_MSGMALFORMED);
+
+	if (fails) {
+		fprintf(stderr, "machine: FAILED\n");
+		return 1;
+	}
+
+	printf("machine: all exchanges passed\n");
+	return 0;
+}
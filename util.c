@@ -78,6 +78,40 @@ int hex_dump(FILE *F, void *data, int size) {
 	return oc;
 }
 
+void run_once(once_t *once, void (*init)(void)) {
+#ifdef __WIN32__
+	if (!*once) {
+		init();
+		*once = true;
+	}
+#else
+	pthread_once(once, init);
+#endif
+}
+
+/** Best level for this CPU, set by cpu_probe(). */
+static enum cpu_level cpu_best = CPU_LEVEL_SCALAR;
+
+/** Makes cpu_probe() run once. */
+static once_t cpu_once = ONCE_INIT;
+
+/** Find the best level for this CPU. Run through run_once(). */
+static void cpu_probe(void) {
+#ifdef CPU_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		cpu_best = CPU_LEVEL_AVX2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		cpu_best = CPU_LEVEL_SSE2;
+	}
+#endif
+}
+
+enum cpu_level cpu_level(void) {
+	run_once(&cpu_once, cpu_probe);
+	return cpu_best;
+}
+
 double get_ticks() {
 #ifdef __WIN32__
 	return (double)GetTickCount() / (double)1000.0;
@@ -430,8 +464,80 @@ uint8_t checksum8(uint8_t *buf, int size) {
 	return (sum & 0x00FF);
 }
 
+#ifdef CPU_X86
+
+/**
+	Sum bytes with SSE2.
+	PSADBW against zero adds up 8 bytes into each 64 bit lane, the lanes are added at the end.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@param pdone Assigned the number of bytes summed, a multiple of 64.
+	@return Returns the sum of the bytes.
+*/
+__attribute__((target("sse2")))
+static uint64_t checksum_sum_sse2(const uint8_t *buf, size_t size, size_t *pdone) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	size_t i;
+
+	for (i = 0; i + 64 <= size; i += 64) {
+		__m128i a = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i)), zero);
+		__m128i b = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i + 16)), zero);
+		__m128i c = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i + 32)), zero);
+		__m128i d = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i + 48)), zero);
+		acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_add_epi64(a, b), _mm_add_epi64(c, d)));
+	}
+
+	*pdone = i;
+	return (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+}
+
+/**
+	Sum bytes with AVX2.
+	Same as checksum_sum_sse2() with 32 byte vectors.
+	@param buf The buffer.
+	@param size Number of bytes in buf[].
+	@param pdone Assigned the number of bytes summed, a multiple of 128.
+	@return Returns the sum of the bytes.
+*/
+__attribute__((target("avx2")))
+static uint64_t checksum_sum_avx2(const uint8_t *buf, size_t size, size_t *pdone) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	size_t i;
+
+	for (i = 0; i + 128 <= size; i += 128) {
+		__m256i a = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(buf + i)), zero);
+		__m256i b = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(buf + i + 32)), zero);
+		__m256i c = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(buf + i + 64)), zero);
+		__m256i d = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(buf + i + 96)), zero);
+		acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_add_epi64(a, b), _mm256_add_epi64(c, d)));
+	}
+
+	__m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+
+	*pdone = i;
+	return (uint64_t)_mm_cvtsi128_si32(half) + (uint64_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half));
+}
+
+#endif //CPU_X86
+
 uint16_t checksum16(uint8_t *buf, int size) {
 	uint16_t sum = 0;
+	size_t done = 0;
+
+#ifdef CPU_X86
+	enum cpu_level level = cpu_level();
+
+	if (size > 0 && level == CPU_LEVEL_AVX2) {
+		sum = checksum_sum_avx2(buf, size, &done);
+	} else if (size > 0 && level == CPU_LEVEL_SSE2) {
+		sum = checksum_sum_sse2(buf, size, &done);
+	}
+	buf += done;
+	size -= done;
+#endif
+
 	while (size > 0) {
 		sum += *buf;
 		size--;
@@ -441,28 +547,163 @@ uint16_t checksum16(uint8_t *buf, int size) {
 	return sum;
 }
 
+/** Bytes below which crcitt_feed() does not bother with the carry-less multiply path. */
+#define CRCITT_FOLD_MIN 64
+
 /**
-	Update a crc16 value with some data.
-	@param crc The current checksum.
-	@param value Data to sum into crc.
-	@return Returns the new crc value.
+	Slice-by-8 tables for crcitt_feed(), built on first use.
+	crcitt_table[0][n] is the CRC of byte n, crcitt_table[k][n] the CRC of byte n followed by k zero bytes.
 */
-unsigned int crcitt_update(unsigned int crc, unsigned int value);
-inline unsigned int crcitt_update(unsigned int crc, unsigned int value) {
-    value <<= 8;
-    for (int i = 0; i < 8; i++) {
-        if((crc ^ value) & 0x8000) crc = (crc << 1) ^ 0x1021; else crc <<= 1;
-        value <<= 1;
-    }
-    return crc;
+static uint16_t crcitt_table[8][256];
+
+/** Makes crcitt_init() run once, whichever thread gets there first. */
+static once_t crcitt_once = ONCE_INIT;
+
+/** The CPU has PCLMULQDQ and SSSE3, set by crcitt_init(). */
+static bool crcitt_clmul = false;
+
+/** Fold constants x^192, x^128, x^576 and x^512 mod CRCITT_POLY, set by crcitt_init(). */
+static uint64_t crcitt_k192, crcitt_k128, crcitt_k576, crcitt_k512;
+
+/**
+	Reduce a power of x modulo the polynomial.
+	@param n The power.
+	@return Returns x^n mod (x^16 + CRCITT_POLY).
+*/
+static uint64_t crcitt_xpow(unsigned n) {
+	uint32_t r = 1;
+
+	while (n--) {
+		r <<= 1;
+		if (r & 0x10000) r ^= 0x10000 | CRCITT_POLY;
+	}
+
+	return r;
+}
+
+#ifdef CPU_X86
+
+/**
+	Fold a 128 bit remainder forward by a distance whose constants are in k.
+	@param a The remainder, most significant coefficient in bit 127.
+	@param k x^(d+64) mod P in the high and x^d mod P in the low half.
+	@return Returns a value congruent to a * x^d, at most 80 bits.
+*/
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crcitt_fold(__m128i a, __m128i k) {
+	return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11), _mm_clmulepi64_si128(a, k, 0x00));
+}
+
+/**
+	Fold the data with carry-less multiplies down to 16 bytes with the same CRC.
+	The data is read as one big polynomial, first byte highest. Four 16 byte lanes 64 bytes
+	apart are folded in parallel, then merged, then the last whole blocks are folded in one by one.
+	@param crc CRC of the data before buf[].
+	@param buf The data.
+	@param len Number of bytes in buf[], at least 64.
+	@param rest Receives the 16 bytes whose crcitt() with initial value 0 equals the CRC of buf[].
+	@return Returns the number of bytes folded, a multiple of 16.
+*/
+__attribute__((target("pclmul,ssse3")))
+static size_t crcitt_fold_clmul(uint16_t crc, const uint8_t *buf, size_t len, uint8_t *rest) {
+	//Byte reversal so bit 127 of a register is the top bit of the first byte.
+	const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k128 = _mm_set_epi64x(crcitt_k192, crcitt_k128);
+	const __m128i k512 = _mm_set_epi64x(crcitt_k576, crcitt_k512);
+	__m128i a0, a1, a2, a3;
+	size_t i;
+
+	a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 0)), swap);
+	a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), swap);
+	a2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), swap);
+	a3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), swap);
+
+	//A running CRC adds to the first 16 bits of the message.
+	a0 = _mm_xor_si128(a0, _mm_set_epi64x((uint64_t)crc << 48, 0));
+
+	for (i = 64; i + 64 <= len; i += 64) {
+		a0 = _mm_xor_si128(crcitt_fold(a0, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 0)), swap));
+		a1 = _mm_xor_si128(crcitt_fold(a1, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 16)), swap));
+		a2 = _mm_xor_si128(crcitt_fold(a2, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 32)), swap));
+		a3 = _mm_xor_si128(crcitt_fold(a3, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 48)), swap));
+	}
+
+	a0 = _mm_xor_si128(crcitt_fold(a0, k128), a1);
+	a0 = _mm_xor_si128(crcitt_fold(a0, k128), a2);
+	a0 = _mm_xor_si128(crcitt_fold(a0, k128), a3);
+
+	for (; i + 16 <= len; i += 16) {
+		a0 = _mm_xor_si128(crcitt_fold(a0, k128), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), swap));
+	}
+
+	_mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(a0, swap));
+	return i;
+}
+
+#endif //CPU_X86
+
+/** Build crcitt_table[]. */
+static void crcitt_init(void) {
+	uint16_t crc;
+	int n, k;
+
+	for (n = 0; n < 256; n++) {
+		crc = n << 8;
+		for (k = 0; k < 8; k++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ CRCITT_POLY : (crc << 1);
+		}
+		crcitt_table[0][n] = crc;
+	}
+
+	for (k = 1; k < 8; k++) {
+		for (n = 0; n < 256; n++) {
+			crc = crcitt_table[k - 1][n];
+			crcitt_table[k][n] = (crc << 8) ^ crcitt_table[0][crc >> 8];
+		}
+	}
+
+	crcitt_k192 = crcitt_xpow(192);
+	crcitt_k128 = crcitt_xpow(128);
+	crcitt_k576 = crcitt_xpow(576);
+	crcitt_k512 = crcitt_xpow(512);
+
+#ifdef CPU_X86
+	__builtin_cpu_init();
+	crcitt_clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#endif
+
+}
+
+uint16_t crcitt_feed(uint16_t crc, const uint8_t *buf, size_t len) {
+	const uint16_t (*t)[256] = (const uint16_t (*)[256])crcitt_table;
+
+	run_once(&crcitt_once, crcitt_init);
+
+#ifdef CPU_X86
+	if (crcitt_clmul && len >= CRCITT_FOLD_MIN) {
+		uint8_t rest[16];
+		size_t n = crcitt_fold_clmul(crc, buf, len, rest);
+		crc = crcitt_feed(0, rest, sizeof(rest));
+		buf += n;
+		len -= n;
+	}
+#endif
+
+	//Eight bytes per round, the CRC only mixes into the first two.
+	for (; len >= 8; len -= 8, buf += 8) {
+		crc = t[7][buf[0] ^ (crc >> 8)] ^ t[6][buf[1] ^ (crc & 0xFF)]
+			^ t[5][buf[2]] ^ t[4][buf[3]] ^ t[3][buf[4]] ^ t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+	}
+
+	for (; len > 0; len--, buf++) {
+		crc = (crc << 8) ^ t[0][(crc >> 8) ^ *buf];
+	}
+
+	return crc;
 }
 
 unsigned int crcitt(uint8_t *buf, int len) {
-    unsigned int crc;
-	for (crc = 0; len; len--, buf++) {
-        crc = crcitt_update(crc, (unsigned int)*buf);
-    }
-    return crc;
+	return crcitt_feed(0, buf, len > 0 ? len : 0);
 }
 
 long filedata(const char *path, uint8_t **buf) {
@@ -503,6 +744,164 @@ long filedata(const char *path, uint8_t **buf) {
 	return nread;
 }
 
+int fileidentity(const char *path, uint64_t *id, int settle, bool *psettled) {
+#ifdef __WIN32__
+	BY_HANDLE_FILE_INFORMATION info;
+	FILETIME now;
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return E_OPEN;
+	}
+	if (!GetFileInformationByHandle(file, &info)) {
+		CloseHandle(file);
+		return E_OPEN;
+	}
+	CloseHandle(file);
+
+	id[0] = info.dwVolumeSerialNumber;
+	id[1] = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	id[2] = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	id[3] = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+	id[4] = ((uint64_t)info.ftCreationTime.dwHighDateTime << 32) | info.ftCreationTime.dwLowDateTime;
+
+	//File times count 100 ns ticks.
+	GetSystemTimeAsFileTime(&now);
+	*psettled = (((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime) > id[3] + settle * 10000000ULL;
+#else
+	struct stat st;
+
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return E_OPEN;
+	}
+
+	id[0] = st.st_dev;
+	id[1] = st.st_ino;
+	id[2] = st.st_size;
+	id[3] = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+	id[4] = (uint64_t)st.st_ctim.tv_sec * 1000000000ULL + st.st_ctim.tv_nsec;
+
+	*psettled = time(NULL) > st.st_mtim.tv_sec + settle && time(NULL) > st.st_ctim.tv_sec + settle;
+#endif
+
+	return E_NONE;
+}
+
+const uint8_t *filemap(const char *path, size_t *size) {
+	const uint8_t *data = NULL;
+
+	assert(path);
+	assert(size);
+
+	*size = 0;
+
+#ifdef __WIN32__
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	LARGE_INTEGER fsize;
+	if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fsize) && fsize.QuadPart > 0) {
+		//The view keeps the mapping alive after the handles are closed.
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+		if (data) {
+			*size = (size_t)fsize.QuadPart;
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			data = (const uint8_t *)map;
+			*size = st.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	return data;
+}
+
+void fileunmap(const uint8_t *data, size_t size) {
+	if (data == NULL) {
+		return;
+	}
+
+#ifdef __WIN32__
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+int filebuf_open(struct filebuf *fb, const char *path) {
+	size_t cap = 64 * 1024;
+	size_t n;
+	uint8_t *buf;
+	FILE *F;
+
+	memset(fb, 0x00, sizeof(struct filebuf));
+
+	if (strcmp(path, "-") != 0) {
+		fb->data = filemap(path, &fb->size);
+		if (fb->data) {
+			fb->mapped = true;
+			return E_NONE;
+		}
+	}
+
+	F = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+	if (F == NULL) {
+		LOGE("Could not open '%s' for reading.", path);
+		return E_OPEN;
+	}
+
+	buf = (uint8_t *)malloc(cap);
+	assert(buf);
+	while ((n = fread(buf + fb->size, 1, cap - fb->size, F)) > 0) {
+		fb->size += n;
+		if (fb->size == cap) {
+			cap *= 2;
+			buf = (uint8_t *)realloc(buf, cap);
+			assert(buf);
+		}
+	}
+
+	if (ferror(F)) {
+		LOGE("Error reading from '%s'.", path);
+		free(buf);
+		if (F != stdin) fclose(F);
+		fb->size = 0;
+		return E_READ;
+	}
+
+	if (F != stdin) fclose(F);
+	fb->data = buf;
+	return E_NONE;
+}
+
+void filebuf_close(struct filebuf *fb) {
+	if (fb->mapped) {
+		fileunmap(fb->data, fb->size);
+	} else {
+		free((void *)fb->data);
+	}
+	memset(fb, 0x00, sizeof(struct filebuf));
+}
+
 #ifdef __WIN32__
 void chdir_to_exe() {
 	static char exepath[MAX_PATH];